@@ -64,6 +64,13 @@ struct action_lookup  ac_lookup_table[] = {
 
 ev_list *head = NULL;
 
+/* atoms used by the xevent action */
+struct atom_cache {
+	char *name;
+	Atom atom;
+} xev_atoms[MAXACTIONS];
+int xev_atom_cnt = 0;
+
 static ev_list *
 alloc_event(long evid)
 {
@@ -204,6 +211,15 @@ get_action_handler(const char *acname) {
 	return NULL;
 }
 
+/* host mode, every bar has its own events */
+void
+swap_event_list(void **events) {
+	ev_list *tmp = head;
+
+	head = *events;
+	*events = tmp;
+}
+
 void
 free_event_list(void) {
 	ev_list *item;
@@ -268,6 +284,34 @@ fill_ev_table(char *input) {
 	}
 }
 
+/* runs a list of actions right away, in the format of fill_ev_action().
+ * Returns the number of unknown actions. */
+int
+run_actions(char *action) {
+	char *str, *kommatoken, *dptoken, *saveptr=NULL;
+	handlerf *ah;
+	As as;
+	int bad = 0;
+
+	for (str = action; ; str = NULL) {
+		kommatoken = strtok_r(str, ",", &saveptr);
+		if (kommatoken == NULL)
+			break;
+
+		if ((dptoken = strchr(kommatoken, ':')))
+			*dptoken++ = 0;
+
+		if (!(ah = get_action_handler(kommatoken))) {
+			bad++;
+			continue;
+		}
+		fill_options(&as, dptoken);
+		ah(as.options);
+		free(as.options[0]);
+	}
+	return bad;
+}
+
 
 /* actions */
 int
@@ -283,7 +327,8 @@ a_collapse(char * opt[]){
 	(void)opt;
 	if(!dzen.slave_win.ishmenu
 			&& dzen.slave_win.max_lines
-			&& !dzen.slave_win.issticky) {
+			&& !dzen.slave_win.issticky
+			&& dzen.slave_win.win) {
 		XUnmapWindow(dzen.dpy, dzen.slave_win.win);
 	}
 	return 0;
@@ -291,25 +336,21 @@ a_collapse(char * opt[]){
 
 int
 a_uncollapse(char * opt[]){
-	int i;
 	(void)opt;
 	if(!dzen.slave_win.ishmenu
 			&& dzen.slave_win.max_lines
 			&& !dzen.slave_win.issticky) {
+		x_create_slave();
 		XMapRaised(dzen.dpy, dzen.slave_win.win);
-		for(i=0; i < dzen.slave_win.max_lines; i++)
-			XMapWindow(dzen.dpy, dzen.slave_win.line[i]);
 	}
 	return 0;
 }
 
 int
 a_togglecollapse(char * opt[]){
-	XWindowAttributes wa;
 	(void)opt;
 
-	if(dzen.slave_win.max_lines &&
-			(XGetWindowAttributes(dzen.dpy, dzen.slave_win.win, &wa), wa.map_state == IsUnmapped))
+	if(dzen.slave_win.max_lines && !dzen.slave_win.ismapped)
 		a_uncollapse(NULL);
 	else
 		a_collapse(NULL);
@@ -346,15 +387,15 @@ a_togglestick(char * opt[]) {
 
 static void
 scroll(int n) {
-	if(dzen.slave_win.tcnt <= dzen.slave_win.max_lines)
+	if(SLAVE_CNT() <= dzen.slave_win.max_lines)
 		return;
 	if(dzen.slave_win.first_line_vis + n < 0) {
 		dzen.slave_win.first_line_vis = 0;
 		dzen.slave_win.last_line_vis = dzen.slave_win.max_lines;
 	}
-	else if(dzen.slave_win.last_line_vis + n > dzen.slave_win.tcnt) {
-		dzen.slave_win.first_line_vis = dzen.slave_win.tcnt - dzen.slave_win.max_lines;
-		dzen.slave_win.last_line_vis = dzen.slave_win.tcnt;
+	else if(dzen.slave_win.last_line_vis + n > SLAVE_CNT()) {
+		dzen.slave_win.first_line_vis = SLAVE_CNT() - dzen.slave_win.max_lines;
+		dzen.slave_win.last_line_vis = SLAVE_CNT();
 	}
 	else {
 		dzen.slave_win.first_line_vis += n;
@@ -439,6 +480,52 @@ a_exec(char * opt[]) {
 	return 0;
 }
 
+static Atom
+xevent_atom(const char *name) {
+	Atom a;
+	int i;
+
+	for(i=0; i < xev_atom_cnt; i++)
+		if(!strcmp(xev_atoms[i].name, name))
+			return xev_atoms[i].atom;
+
+	ROUNDTRIP();
+	a = XInternAtom(dzen.dpy, name, True);
+	if(a != None && xev_atom_cnt < MAXACTIONS) {
+		xev_atoms[xev_atom_cnt].name = estrdup(name);
+		xev_atoms[xev_atom_cnt].atom = a;
+		xev_atom_cnt++;
+	}
+	return a;
+}
+
+/* intern the atoms of all configured xevent actions in one go */
+void
+intern_action_atoms(void) {
+	char *names[MAXACTIONS];
+	Atom atoms[MAXACTIONS];
+	ev_list *item;
+	int i, n=0;
+
+	for(item = head; item; item = item->next)
+		for(i=0; i < MAXACTIONS && item->action[i] && item->action[i]->handler; i++)
+			if(item->action[i]->handler == a_xevent
+					&& item->action[i]->options[0]
+					&& *item->action[i]->options[0]
+					&& n < MAXACTIONS)
+				names[n++] = item->action[i]->options[0];
+
+	if(!n || !XInternAtoms(dzen.dpy, names, n, True, atoms))
+		return;
+
+	for(i=0; i < n && xev_atom_cnt < MAXACTIONS; i++)
+		if(atoms[i] != None) {
+			xev_atoms[xev_atom_cnt].name = estrdup(names[i]);
+			xev_atoms[xev_atom_cnt].atom = atoms[i];
+			xev_atom_cnt++;
+		}
+}
+
 int
 a_xevent(char * opt[]) {
 	XClientMessageEvent e = { ClientMessage };
@@ -449,7 +536,7 @@ a_xevent(char * opt[]) {
 
 	e.display = dzen.dpy;
 	e.window = RootWindow(dzen.dpy, dzen.screen);
-	e.message_type = XInternAtom(dzen.dpy, opt[0], True);
+	e.message_type = xevent_atom(opt[0]);
 	if(e.message_type == None)
 		return 0;
 	e.format = 32;
@@ -477,7 +564,7 @@ a_menuprint(char * opt[]) {
 	int i;
 
 	if(dzen.slave_win.ismenu && dzen.slave_win.sel_line != -1
-			&& (dzen.slave_win.sel_line + dzen.slave_win.first_line_vis) < dzen.slave_win.tcnt) {
+			&& (dzen.slave_win.sel_line + dzen.slave_win.first_line_vis) < SLAVE_CNT()) {
 		text = parse_line(NULL, dzen.slave_win.sel_line, 0, 0, 1);
 		printf("%s", text);
 		if(opt)
@@ -496,8 +583,8 @@ a_menuprint_noparse(char * opt[]) {
 	int i;
 
 	if(dzen.slave_win.ismenu && dzen.slave_win.sel_line != -1
-			&& (dzen.slave_win.sel_line + dzen.slave_win.first_line_vis) < dzen.slave_win.tcnt) {
-		printf("%s", dzen.slave_win.tbuf[dzen.slave_win.sel_line]);
+			&& (dzen.slave_win.sel_line + dzen.slave_win.first_line_vis) < SLAVE_CNT()) {
+		printf("%s", slave_text(SLAVE_LINE(dzen.slave_win.first_line_vis + dzen.slave_win.sel_line)));
 		if(opt)
 			for(i=0; opt[i]; ++i)
 				printf("%s", opt[i]);
@@ -514,7 +601,7 @@ a_menuexec(char * opt[]) {
 	(void)opt;
 
 	if(dzen.slave_win.ismenu && dzen.slave_win.sel_line != -1
-			&& (dzen.slave_win.sel_line + dzen.slave_win.first_line_vis) < dzen.slave_win.tcnt) {
+			&& (dzen.slave_win.sel_line + dzen.slave_win.first_line_vis) < SLAVE_CNT()) {
 		text = parse_line(NULL, dzen.slave_win.sel_line, 0, 0, 1);
 		spawn(text);
 		dzen.slave_win.sel_line = -1;
@@ -528,7 +615,7 @@ a_raise(char * opt[]) {
 	(void)opt;
 	XRaiseWindow(dzen.dpy, dzen.title_win.win);
 
-	if(dzen.slave_win.max_lines)
+	if(dzen.slave_win.win)
 		XRaiseWindow(dzen.dpy, dzen.slave_win.win);
 	return 0;
 }
@@ -538,7 +625,7 @@ a_lower(char * opt[]) {
 	(void)opt;
 	XLowerWindow(dzen.dpy, dzen.title_win.win);
 
-	if(dzen.slave_win.max_lines)
+	if(dzen.slave_win.win)
 		XLowerWindow(dzen.dpy, dzen.slave_win.win);
 	return 0;
 }
@@ -559,8 +646,9 @@ int
 a_scrollend(char * opt[]) {
 	(void)opt;
 	if(dzen.slave_win.max_lines) {
-		dzen.slave_win.first_line_vis = dzen.slave_win.tcnt - dzen.slave_win.max_lines ;
-		dzen.slave_win.last_line_vis  = dzen.slave_win.tcnt;
+		dzen.slave_win.first_line_vis = SLAVE_CNT() > dzen.slave_win.max_lines ?
+			SLAVE_CNT() - dzen.slave_win.max_lines : 0;
+		dzen.slave_win.last_line_vis  = SLAVE_CNT();
 
 		x_draw_body();
 	}
@@ -57,8 +57,11 @@ int get_ev_id(const char *);
 handlerf *get_action_handler(const char *);
 void fill_ev_action(long, char *);
 void fill_ev_table(char *);
+int run_actions(char *);
 void free_event_list(void);
+void swap_event_list(void **);
 int find_event(long);
+void intern_action_atoms(void);
 
 /* action handlers */
 int a_print(char **);
@@ -0,0 +1,164 @@
+/*
+ * (C)opyright 2007-2009 Robert Manea <rob dot manea at gmail dot com>
+ * See LICENSE file for license details.
+ *
+ */
+
+/* Per-line colors for the slave window, see '-colorize'.
+ *
+ * Every slave line is classified once when it is read.  Plain text
+ * patterns are matched together by one Aho-Corasick automaton, so
+ * their cost does not grow with the number of rules.  Patterns using
+ * regular expression syntax are tried one by one, and only while no
+ * earlier rule has matched.  The first rule in the list that matches
+ * a line decides its color.
+ */
+
+#include "dzen.h"
+
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+	unsigned long color;
+	int isregex;
+	regex_t re;
+} rule_c;
+
+static rule_c *rules;
+static int rule_cnt;
+
+/* automaton over the literal patterns, every state has a complete
+ * transition table so matching is one lookup per input byte */
+static int (*ac_next)[256];
+static int *ac_out;		/* first rule ending in a state, rule_cnt if none */
+static int ac_cnt, ac_none;
+
+static int
+isregex(const char *p) {
+	return strpbrk(p, ".[]()*+?{}|^$\\") != NULL;
+}
+
+static void
+ac_add(const char *p, int rule) {
+	int s = 0, c;
+
+	for(; *p; p++) {
+		c = (unsigned char)*p;
+		if(!ac_next[s][c]) {
+			ac_next[s][c] = ac_cnt;
+			ac_out[ac_cnt++] = ac_none;
+		}
+		s = ac_next[s][c];
+	}
+	if(rule < ac_out[s])
+		ac_out[s] = rule;
+}
+
+/* fill in failure transitions breadth first */
+static void
+ac_build(void) {
+	int *queue, *fail;
+	int qh = 0, qt = 0, s, t, c;
+
+	queue = emalloc(ac_cnt * sizeof(int));
+	fail  = emalloc(ac_cnt * sizeof(int));
+
+	for(c=0; c < 256; c++)
+		if((t = ac_next[0][c])) {
+			fail[t] = 0;
+			queue[qt++] = t;
+		}
+	while(qh < qt) {
+		s = queue[qh++];
+		if(ac_out[fail[s]] < ac_out[s])
+			ac_out[s] = ac_out[fail[s]];
+		for(c=0; c < 256; c++) {
+			if((t = ac_next[s][c])) {
+				fail[t] = ac_next[fail[s]][c];
+				queue[qt++] = t;
+			}
+			else
+				ac_next[s][c] = ac_next[fail[s]][c];
+		}
+	}
+	free(queue);
+	free(fail);
+}
+
+/* rules are 'pattern=color;pattern=color;...' */
+void
+colorize_init(const char *spec) {
+	char *buf, *r, *eq, *next;
+	int n, len = 1;
+
+	buf = estrdup(spec);
+	for(n=1, r=buf; *r; r++)
+		if(*r == ';')
+			n++;
+	rules = emalloc(n * sizeof(rule_c));
+
+	/* at most one state per pattern byte, plus the root */
+	len += strlen(buf);
+	ac_next = emalloc(len * sizeof(*ac_next));
+	ac_out  = emalloc(len * sizeof(int));
+	memset(ac_next, 0, len * sizeof(*ac_next));
+	ac_out[0] = ac_none = n;
+	ac_cnt = 1;
+
+	for(r = buf; r; r = next) {
+		if((next = strchr(r, ';')))
+			*next++ = '\0';
+		/* colors never contain '=', patterns may */
+		if(!(eq = strrchr(r, '=')) || eq == r) {
+			if(*r)
+				fprintf(stderr, "dzen: colorize: ignoring rule '%s'\n", r);
+			continue;
+		}
+		*eq++ = '\0';
+
+		rules[rule_cnt].color = getcolor(eq);
+		if(rules[rule_cnt].color == ~0lu) {
+			fprintf(stderr, "dzen: colorize: unknown color '%s'\n", eq);
+			continue;
+		}
+		if((rules[rule_cnt].isregex = isregex(r))) {
+			if(regcomp(&rules[rule_cnt].re, r, REG_EXTENDED | REG_NOSUB)) {
+				fprintf(stderr, "dzen: colorize: bad pattern '%s'\n", r);
+				continue;
+			}
+		}
+		else
+			ac_add(r, rule_cnt);
+		rule_cnt++;
+	}
+	/* rules dropped above leave fewer than counted */
+	for(n=0; n < ac_cnt; n++)
+		if(ac_out[n] > rule_cnt)
+			ac_out[n] = rule_cnt;
+	ac_build();
+	free(buf);
+
+	dzen.colorize = rule_cnt > 0;
+}
+
+unsigned long
+colorize_line(const char *text) {
+	const unsigned char *p;
+	int s = 0, best = rule_cnt, i;
+
+	for(p = (const unsigned char *)text; *p && best; p++) {
+		s = ac_next[s][*p];
+		if(ac_out[s] < best)
+			best = ac_out[s];
+	}
+	for(i=0; i < best; i++)
+		if(rules[i].isregex && !regexec(&rules[i].re, text, 0, NULL, 0)) {
+			best = i;
+			break;
+		}
+
+	return best < rule_cnt ? rules[best].color : dzen.norm[ColFG];
+}
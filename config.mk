@@ -53,20 +53,25 @@ CFLAGS = -Wall -Os ${INCS} -DVERSION=\"${VERSION}\" -DDZEN_XFT `pkg-config --cfl
 #CFLAGS = -Wall -Os ${INCS} -DVERSION=\"${VERSION}\" -DDZEN_XINERAMA -DDZEN_XPM -DDZEN_XFT `pkg-config --cflags xft`
 
 
+## Option 8: With Xinerama, XRandR and XFT, follows monitors that come and go
+#LIBS = -L/usr/lib -lc -L${X11LIB} -lX11 -lXinerama -lXrandr `pkg-config --libs xft`
+#CFLAGS = -Wall -Os ${INCS} -DVERSION=\"${VERSION}\" -DDZEN_XINERAMA -DDZEN_XRANDR -DDZEN_XFT `pkg-config --cflags xft`
+
+
 
 # END of feature configuration
 
 
-LDFLAGS = ${LIBS}
+LDFLAGS = ${LIBS} -lpthread
 
 # Solaris, uncomment for Solaris
 #CFLAGS = -fast ${INCS} -DVERSION=\"${VERSION}\"
-#LDFLAGS = ${LIBS}
+#LDFLAGS = ${LIBS} -lpthread
 #CFLAGS += -xtarget=ultra
 
 # Debugging
-#CFLAGS = ${INCS} -DVERSION=\"${VERSION}\" -std=gnu89 -pedantic -Wall -W -Wundef -Wendif-labels -Wshadow -Wpointer-arith -Wbad-function-cast -Wcast-align -Wwrite-strings -Wstrict-prototypes -Wmissing-prototypes -Wnested-externs -Winline -Wdisabled-optimization -O2 -pipe -DDZEN_XFT `pkg-config --cflags xft`
-#LDFLAGS = ${LIBS}
+#CFLAGS = ${INCS} -DVERSION=\"${VERSION}\" -DDZEN_DEBUG -std=gnu89 -pedantic -Wall -W -Wundef -Wendif-labels -Wshadow -Wpointer-arith -Wbad-function-cast -Wcast-align -Wwrite-strings -Wstrict-prototypes -Wmissing-prototypes -Wnested-externs -Winline -Wdisabled-optimization -O2 -pipe -DDZEN_XFT `pkg-config --cflags xft`
+#LDFLAGS = ${LIBS} -lpthread
 
 # compiler and linker
 CC = gcc
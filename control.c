@@ -0,0 +1,224 @@
+/*
+ * (C)opyright 2007-2009 Robert Manea <rob dot manea at gmail dot com>
+ * See LICENSE file for license details.
+ *
+ */
+
+/* Unix domain control socket, see '-socket'.
+ *
+ * Any number of clients may connect and send commands, one per line:
+ *
+ *   title <text>     draw text in the title window
+ *   slave <text>     add text as a slave window line
+ *   line <text>      handle text as if it was read from stdin
+ *   action <list>    run actions, as given to '-e', eg. 'scrollup,raise'
+ *   query            report the state of the windows
+ *
+ * Every command is answered by a line starting with 'ok' or 'error'.
+ * A client not reading its answers only loses them.
+ */
+
+#include "dzen.h"
+#include "action.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define MAX_CLIENTS 64
+
+typedef struct {
+	int fd;
+	int len;
+	char buf[MAX_LINE_LEN];
+} Client;
+
+static int lfd = -1;
+static char *lpath;
+static Client clients[MAX_CLIENTS];
+static int ccnt;
+
+static void
+nonblock(int fd) {
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+/* listens on path, an old socket left there is replaced, but no
+ * other file; only the user may connect as commands can run programs */
+void
+control_start(const char *path) {
+	struct sockaddr_un sa;
+	struct stat st;
+	mode_t mask;
+	int r;
+
+	if(strlen(path) >= sizeof sa.sun_path)
+		eprint("dzen: socket path '%s' too long\n", path);
+	memset(&sa, 0, sizeof sa);
+	sa.sun_family = AF_UNIX;
+	strcpy(sa.sun_path, path);
+
+	if((lfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		eprint("dzen: cannot create control socket\n");
+	if(lstat(path, &st) == 0) {
+		if(!S_ISSOCK(st.st_mode))
+			eprint("dzen: '%s' exists and is not a socket\n", path);
+		unlink(path);
+	}
+	mask = umask(077);
+	r = bind(lfd, (struct sockaddr *)&sa, sizeof sa);
+	umask(mask);
+	if(r < 0 || listen(lfd, 16) < 0)
+		eprint("dzen: cannot listen on '%s'\n", path);
+	lpath = estrdup(path);
+	nonblock(lfd);
+}
+
+/* removes the socket again */
+void
+control_stop(void) {
+	if(lfd < 0)
+		return;
+	unlink(lpath);
+	close(lfd);
+	lfd = -1;
+}
+
+/* adds the descriptors to watch to rmask, returns the highest one */
+int
+control_fds(fd_set *rmask, int maxfd) {
+	int i;
+
+	if(lfd < 0)
+		return maxfd;
+	FD_SET(lfd, rmask);
+	maxfd = maxfd > lfd ? maxfd : lfd;
+	for(i=0; i < ccnt; i++) {
+		FD_SET(clients[i].fd, rmask);
+		maxfd = maxfd > clients[i].fd ? maxfd : clients[i].fd;
+	}
+	return maxfd;
+}
+
+static void
+reply(Client *c, const char *msg) {
+	if(send(c->fd, msg, strlen(msg), MSG_NOSIGNAL) < 0)
+		;
+}
+
+static void
+query(Client *c) {
+	char buf[256];
+
+	snprintf(buf, sizeof buf,
+			"ok lines=%d first=%d last=%d sel=%d collapsed=%d hidden=%d sticky=%d\n",
+			SLAVE_CNT(), dzen.slave_win.first_line_vis,
+			dzen.slave_win.last_line_vis, dzen.slave_win.sel_line,
+			!dzen.slave_win.ismapped, dzen.title_win.ishidden,
+			dzen.slave_win.issticky);
+	reply(c, buf);
+}
+
+/* runs one command, returns 1 if it added slave lines */
+static int
+command(Client *c, char *cmd) {
+	char *arg;
+
+	if((arg = strchr(cmd, ' ')))
+		*arg++ = '\0';
+	else
+		arg = cmd + strlen(cmd);
+
+	if(!strcmp(cmd, "title")) {
+		drawheader(arg);
+		reply(c, "ok\n");
+	}
+	else if(!strcmp(cmd, "slave")) {
+		if(!dzen.slave_win.max_lines) {
+			reply(c, "error no slave window\n");
+			return 0;
+		}
+		drawbody(arg);
+		reply(c, "ok\n");
+		return 1;
+	}
+	else if(!strcmp(cmd, "line")) {
+		process_line(arg);
+		reply(c, "ok\n");
+		return 1;
+	}
+	else if(!strcmp(cmd, "action")) {
+		if(run_actions(arg))
+			reply(c, "error unknown action\n");
+		else
+			reply(c, "ok\n");
+	}
+	else if(!strcmp(cmd, "query"))
+		query(c);
+	else
+		reply(c, "error unknown command\n");
+	return 0;
+}
+
+/* reads from client i, returns -1 once it is gone */
+static int
+client_read(int i, int *added) {
+	Client *c = &clients[i];
+	char buf[4096];
+	ssize_t n, j;
+
+	if((n = read(c->fd, buf, sizeof buf)) < 0 && errno == EAGAIN)
+		return 0;
+	if(n <= 0)
+		return -1;
+
+	for(j=0; j < n; j++) {
+		/* overlong lines are split, like chomp() does */
+		if(buf[j] == '\n' || c->len == MAX_LINE_LEN-1) {
+			c->buf[c->len] = '\0';
+			*added |= command(c, c->buf);
+			c->len = 0;
+			if(buf[j] == '\n')
+				continue;
+		}
+		c->buf[c->len++] = buf[j];
+	}
+	return 0;
+}
+
+/* handles what is ready in rmask, returns 1 if slave lines were added */
+int
+control_handle(fd_set *rmask) {
+	int fd, i, added = 0;
+
+	if(lfd < 0)
+		return 0;
+
+	for(i=0; i < ccnt; i++)
+		if(FD_ISSET(clients[i].fd, rmask) && client_read(i, &added) < 0) {
+			close(clients[i].fd);
+			clients[i--] = clients[--ccnt];
+		}
+
+	if(FD_ISSET(lfd, rmask))
+		while((fd = accept(lfd, NULL, NULL)) >= 0) {
+			if(ccnt == MAX_CLIENTS) {
+				close(fd);
+				continue;
+			}
+			nonblock(fd);
+			clients[ccnt].fd = fd;
+			clients[ccnt++].len = 0;
+		}
+	return added;
+}
@@ -0,0 +1,305 @@
+/*
+ * (C)opyright 2007-2009 Robert Manea <rob dot manea at gmail dot com>
+ * See LICENSE file for license details.
+ *
+ */
+
+/* Built-in data sources for the title, see '^ds()'.
+ *
+ * A title containing ^ds(name[,arg]) fields is kept and drawn again
+ * with fresh values whenever one of them changes.  Sources are sampled
+ * once a second, on the second, and are shared by everything showing
+ * them, including all bars in host mode.
+ */
+
+#include "dzen.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_SOURCES 32
+#define DS_ARGLEN   64
+#define DS_VALLEN   64
+#define STATLEN     65536
+
+typedef struct {
+	char name[16];
+	char arg[DS_ARGLEN];
+	char value[DS_VALLEN];
+	int changed;
+	/* counters of the previous sample, for rates */
+	unsigned long long prev[2];
+	struct timeval at;
+} Source;
+
+static Source sources[MAX_SOURCES];
+static int nsources;
+static char expanded[MAX_LINE_LEN];
+static int statfd = -1;
+static char statbuf[STATLEN];
+
+static unsigned long long
+num(const char **p) {
+	unsigned long long n = 0;
+
+	while(**p == ' ')
+		(*p)++;
+	while(**p >= '0' && **p <= '9')
+		n = n * 10 + *(*p)++ - '0';
+	return n;
+}
+
+/* percentage of time busy since the last sample, arg is a cpu number */
+static void
+ds_cpu(Source *s) {
+	char key[DS_ARGLEN+8];
+	unsigned long long v[8], total = 0, idle, dt, di;
+	const char *p;
+	ssize_t n;
+	int i;
+
+	/* kept open, it is read every second */
+	if(statfd < 0 && (statfd = open("/proc/stat", O_RDONLY | O_CLOEXEC)) < 0)
+		return;
+	if((n = pread(statfd, statbuf, sizeof statbuf - 1, 0)) <= 0)
+		return;
+	statbuf[n] = '\0';
+
+	snprintf(key, sizeof key, "cpu%s ", s->arg);
+	for(p = statbuf; strncmp(p, key, strlen(key)); p++)
+		if(!(p = strchr(p, '\n')))
+			return;
+	p += strlen(key);
+	for(i=0; i < 8; i++)
+		total += v[i] = num(&p);
+	idle = v[3] + v[4];
+
+	if(total == s->prev[0])
+		return;
+	/* the first sample or counters gone back, eg. a cpu taken offline */
+	if(!s->prev[0] || total < s->prev[0] || idle < s->prev[1])
+		snprintf(s->value, DS_VALLEN, "0");
+	else {
+		dt = total - s->prev[0];
+		di = idle - s->prev[1];
+		snprintf(s->value, DS_VALLEN, "%llu", di < dt ? 100 * (dt - di) / dt : 0);
+	}
+	s->prev[0] = total;
+	s->prev[1] = idle;
+}
+
+/* percentage of memory in use */
+static void
+ds_mem(Source *s) {
+	char line[256];
+	unsigned long long total = 0, avail = 0;
+	FILE *f;
+
+	if(!(f = fopen("/proc/meminfo", "r")))
+		return;
+	while(fgets(line, sizeof line, f))
+		if(!strncmp(line, "MemTotal:", 9))
+			total = strtoull(line + 9, NULL, 10);
+		else if(!strncmp(line, "MemAvailable:", 13))
+			avail = strtoull(line + 13, NULL, 10);
+	fclose(f);
+
+	if(total)
+		snprintf(s->value, DS_VALLEN, "%llu", 100 * (total - avail) / total);
+}
+
+/* KB/s received or sent on interface arg */
+static void
+ds_net(Source *s, int tx) {
+	char line[512], *p;
+	unsigned long long v[9], bytes = 0;
+	struct timeval now, d;
+	double secs;
+	FILE *f;
+
+	if(!(f = fopen("/proc/net/dev", "r")))
+		return;
+	while(fgets(line, sizeof line, f)) {
+		if(!(p = strchr(line, ':')))
+			continue;
+		*p++ = '\0';
+		if(strcmp(line + strspn(line, " "), s->arg))
+			continue;
+		/* rx bytes is the first field, tx bytes the ninth */
+		if(sscanf(p, "%llu %llu %llu %llu %llu %llu %llu %llu %llu",
+					&v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7], &v[8]) == 9)
+			bytes = tx ? v[8] : v[0];
+		break;
+	}
+	fclose(f);
+
+	gettimeofday(&now, NULL);
+	timersub(&now, &s->at, &d);
+	secs = d.tv_sec + d.tv_usec / 1e6;
+	snprintf(s->value, DS_VALLEN, "%.0f",
+			s->at.tv_sec && secs > 0 && bytes >= s->prev[0] ?
+			(bytes - s->prev[0]) / 1024.0 / secs : 0.0);
+	s->prev[0] = bytes;
+	s->at = now;
+}
+
+/* charge of battery arg in percent */
+static void
+ds_bat(Source *s) {
+	char path[128];
+	FILE *f;
+	int cap;
+
+	snprintf(path, sizeof path, "/sys/class/power_supply/%s/capacity",
+			*s->arg ? s->arg : "BAT0");
+	if(!(f = fopen(path, "r")))
+		return;
+	if(fscanf(f, "%d", &cap) == 1)
+		snprintf(s->value, DS_VALLEN, "%d", cap);
+	fclose(f);
+}
+
+/* local time, formatted by strftime() format arg */
+static void
+ds_clock(Source *s) {
+	time_t t = time(NULL);
+
+	if(!strftime(s->value, DS_VALLEN, *s->arg ? s->arg : "%H:%M", localtime(&t)))
+		s->value[0] = '\0';
+}
+
+static void
+sample(Source *s) {
+	char old[DS_VALLEN];
+
+	strcpy(old, s->value);
+	if(!strcmp(s->name, "cpu"))
+		ds_cpu(s);
+	else if(!strcmp(s->name, "mem"))
+		ds_mem(s);
+	else if(!strcmp(s->name, "rx"))
+		ds_net(s, 0);
+	else if(!strcmp(s->name, "tx"))
+		ds_net(s, 1);
+	else if(!strcmp(s->name, "bat"))
+		ds_bat(s);
+	else if(!strcmp(s->name, "clock"))
+		ds_clock(s);
+	s->changed = strcmp(old, s->value) != 0;
+}
+
+/* the source a field starting at p refers to, *end is set past it */
+static Source *
+field(const char *p, const char **end, int create) {
+	char name[16], arg[DS_ARGLEN];
+	const char *e = strchr(p, ')'), *c;
+	size_t n;
+	Source *s;
+	int i;
+
+	*end = e ? e + 1 : p + strlen(p);
+	if(!e)
+		return NULL;
+	c = memchr(p, ',', e - p);
+	n = (c ? c : e) - p;
+	if(n >= sizeof name)
+		return NULL;
+	memcpy(name, p, n);
+	name[n] = '\0';
+	arg[0] = '\0';
+	if(c && (n = e - c - 1) < sizeof arg) {
+		memcpy(arg, c + 1, n);
+		arg[n] = '\0';
+	}
+
+	for(i=0; i < nsources; i++)
+		if(!strcmp(sources[i].name, name) && !strcmp(sources[i].arg, arg))
+			return &sources[i];
+	if(!create || nsources == MAX_SOURCES)
+		return NULL;
+
+	s = &sources[nsources++];
+	strcpy(s->name, name);
+	strcpy(s->arg, arg);
+	strcpy(s->value, "?");
+	sample(s);
+	return s;
+}
+
+/* returns text with the values of its fields filled in, valid until
+ * the next call */
+const char *
+datasrc_expand(const char *text) {
+	const char *p = text, *end;
+	size_t len = 0, n;
+	Source *s;
+
+	while(*p && len < sizeof expanded - 1) {
+		if(p[0] == '^' && p[1] == '^') {
+			/* ^^ is handled by parse_line() */
+			n = 2;
+		}
+		else if(!strncmp(p, "^ds(", 4)) {
+			s = field(p + 4, &end, 1);
+			p = end;
+			if(s) {
+				n = strlen(s->value);
+				if(len + n >= sizeof expanded)
+					break;
+				memcpy(expanded + len, s->value, n);
+				len += n;
+			}
+			continue;
+		}
+		else
+			n = 1;
+		if(len + n >= sizeof expanded)
+			break;
+		memcpy(expanded + len, p, n);
+		len += n;
+		p += n;
+	}
+	expanded[len] = '\0';
+	return expanded;
+}
+
+/* true if text has a field whose value changed in the last tick */
+int
+datasrc_changed(const char *text) {
+	const char *p = text, *end;
+	Source *s;
+
+	while(*p) {
+		if(p[0] == '^' && p[1] == '^')
+			p += 2;
+		else if(!strncmp(p, "^ds(", 4)) {
+			if((s = field(p + 4, &end, 0)) && s->changed)
+				return 1;
+			p = end;
+		}
+		else
+			p++;
+	}
+	return 0;
+}
+
+/* samples all sources, returns 1 if any value changed */
+int
+datasrc_tick(void) {
+	int i, changed = 0;
+
+	for(i=0; i < nsources; i++) {
+		sample(&sources[i]);
+		changed |= sources[i].changed;
+	}
+	return changed;
+}
+
+int
+datasrc_active(void) {
+	return nsources > 0;
+}
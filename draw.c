@@ -18,6 +18,14 @@
 
 #define ARGLEN 256
 #define MAX_ICON_CACHE 32
+#define MAX_COLOR_CACHE 64
+#define MAX_FONT_CACHE 16
+#define MAX_SCRATCH 2
+#define MAX_GRAPHS 16
+#define MAX_GAUGE_SEGS 512
+#define MAX_SEGMENTS 8
+#define MAX_WIDTH_CACHE 256
+#define WIDTH_TEXTLEN 64
 
 #define MAX(a,b) ((a)>(b)?(a):(b))
 
@@ -30,11 +38,33 @@ typedef struct ICON_C {
 
 icon_c icons[MAX_ICON_CACHE];
 int icon_cnt;
+
+/* allocated colors, so ^fg()/^bg() need no round trip once seen */
+typedef struct COLOR_C {
+	char name[ARGLEN];
+	unsigned long pixel;
+#ifdef DZEN_XFT
+	XftColor xft;
+#endif
+} color_c;
+
+color_c colors[MAX_COLOR_CACHE];
+int color_cnt;
+int color_next;
+
+/* loaded fonts, ^fn() switches back and forth on every line */
+typedef struct FONT_C {
+	char name[ARGLEN];
+	Fnt f;
+} font_c;
+
+font_c fonts[MAX_FONT_CACHE];
+int font_cnt;
 int otx;
-int xorig=0;
+DrawState drawst = { .rep_at = -1 };
 
 /* command types for the in-text parser */
-enum ctype  {bg, fg, icon, rect, recto, circle, circleo, pos, abspos, titlewin, ibg, fn, fixpos, ca, ba};
+enum ctype  {bg, fg, icon, rect, recto, circle, circleo, pos, abspos, titlewin, ibg, fn, fixpos, ca, ba, graph, gauge, al};
 
 struct command_lookup {
 	const char *name;
@@ -57,6 +87,9 @@ struct command_lookup cmd_lookup_table[] = {
 	{ "fn(",        fn,			3},
 	{ "ca(",        ca,			3},
 	{ "ba(",		ba,			3},
+	{ "graph(",		graph,		6},
+	{ "gauge(",		gauge,		6},
+	{ "al(",		al,			3},
 	{ 0,			0,			0}
 };
 
@@ -68,7 +101,7 @@ int get_tokval(const char* line, char **retdata);
 int get_token(const char*  line, int * t, char **tval);
 
 static unsigned int
-textnw(Fnt *font, const char *text, unsigned int len) {
+xtextnw(Fnt *font, const char *text, unsigned int len) {
 #ifndef DZEN_XFT
 	XRectangle r;
 
@@ -85,17 +118,120 @@ textnw(Fnt *font, const char *text, unsigned int len) {
 #endif
 }
 
+/* widths of the text between commands, which mostly repeats from one
+ * update to the next and is measured twice in lines with ^al() */
+typedef struct {
+	const void *font;
+	unsigned int len, w;
+#ifdef DZEN_XFT
+	int h;		/* raises the font height like xtextnw() */
+#endif
+	char text[WIDTH_TEXTLEN];
+} width_c;
+
+static width_c widths[MAX_WIDTH_CACHE];
+
+static unsigned int
+textnw(Fnt *font, const char *text, unsigned int len) {
+	unsigned int h = 5381, i;
+	const void *id;
+	width_c *c;
+
+	if(len >= WIDTH_TEXTLEN)
+		return xtextnw(font, text, len);
+#ifndef DZEN_XFT
+	id = font->set ? (const void *)font->set : (const void *)font->xfont;
+#else
+	id = dzen.font.xftfont;
+#endif
+	for(i=0; i < len; i++)
+		h = h * 33 + (unsigned char)text[i];
+	c = &widths[h % MAX_WIDTH_CACHE];
+	if(c->font != id || c->len != len || memcmp(c->text, text, len)) {
+		c->w = xtextnw(font, text, len);
+#ifdef DZEN_XFT
+		c->h = dzen.font.extents->height;
+#endif
+		c->font = id;
+		c->len = len;
+		memcpy(c->text, text, len);
+	}
+#ifdef DZEN_XFT
+	else if(c->h > dzen.font.height)
+		dzen.font.height = c->h;
+#endif
+	return c->w;
+}
+
+
+/* Lines are composed in an off-screen pixmap before being copied to
+ * their window's pixmap.  One is kept per width in use, the title and
+ * the slave lines, instead of creating one for every line drawn. */
+typedef struct {
+	int width;
+	Pixmap pm;
+#ifdef DZEN_XFT
+	XftDraw *xftd;
+#endif
+} scratch_c;
+
+static scratch_c scratch[MAX_SCRATCH];
+static int scratch_next;
+
+static scratch_c *
+getscratch(int width) {
+	scratch_c *sc;
+	int i;
+
+	for(i=0; i < MAX_SCRATCH; i++)
+		if(scratch[i].pm && scratch[i].width == width)
+			return &scratch[i];
+
+	sc = &scratch[scratch_next];
+	scratch_next = (scratch_next + 1) % MAX_SCRATCH;
+	if(sc->pm) {
+#ifdef DZEN_XFT
+		XftDrawDestroy(sc->xftd);
+#endif
+		XFreePixmap(dzen.dpy, sc->pm);
+	}
+	sc->width = width;
+	sc->pm = XCreatePixmap(dzen.dpy, RootWindow(dzen.dpy, DefaultScreen(dzen.dpy)), width,
+			dzen.line_height, DefaultDepth(dzen.dpy, dzen.screen));
+#ifdef DZEN_XFT
+	sc->xftd = XftDrawCreate(dzen.dpy, sc->pm, DefaultVisual(dzen.dpy, dzen.screen),
+			DefaultColormap(dzen.dpy, dzen.screen));
+#endif
+	return sc;
+}
+
+/* The slave window is rendered into a single pixmap whose rows form
+ * a ring indexed by input line, so scrolling only has to render the
+ * lines entering the view.  Menus keep a second pixmap with the
+ * highlighted rendering of each line. */
+Drawable
+slave_drawable(int reverse) {
+	if(reverse && dzen.slave_win.rdrawable)
+		return dzen.slave_win.rdrawable;
+	return dzen.slave_win.drawable;
+}
+
+int
+slave_row_y(int line) {
+	return ((dzen.slave_win.first_line_vis + line) % dzen.slave_win.max_lines)
+		* dzen.line_height;
+}
 
 void
 drawtext(const char *text, int reverse, int line, int align) {
 	if(!reverse) {
 		XSetForeground(dzen.dpy, dzen.gc, dzen.norm[ColBG]);
-		XFillRectangle(dzen.dpy, dzen.slave_win.drawable[line], dzen.gc, 0, 0, dzen.w, dzen.h);
+		XFillRectangle(dzen.dpy, slave_drawable(0), dzen.gc, 0, slave_row_y(line), dzen.w, dzen.h);
 		XSetForeground(dzen.dpy, dzen.gc, dzen.norm[ColFG]);
 	}
 	else {
 		XSetForeground(dzen.dpy, dzen.rgc, dzen.norm[ColFG]);
-		XFillRectangle(dzen.dpy, dzen.slave_win.drawable[line], dzen.rgc, 0, 0, dzen.w, dzen.h);
+		XFillRectangle(dzen.dpy, slave_drawable(1), dzen.rgc, 0, slave_row_y(line), dzen.w, dzen.h);
 		XSetForeground(dzen.dpy, dzen.rgc, dzen.norm[ColBG]);
 	}
 
@@ -106,65 +242,169 @@ long
 getcolor(const char *colstr) {
 	Colormap cmap = DefaultColormap(dzen.dpy, dzen.screen);
 	XColor color;
+	color_c *c;
+	int i;
+#ifdef DZEN_XFT
+	XRenderColor rc;
+#endif
+
+	for(i=0; i < color_cnt; i++)
+		if(!strncmp(colors[i].name, colstr, ARGLEN))
+			return colors[i].pixel;
 
+	ROUNDTRIP();
 	if(!XAllocNamedColor(dzen.dpy, cmap, colstr, &color, &color))
 		return -1;
 
+	/* replace the oldest entry once the cache is full */
+	c = &colors[color_next];
+	color_next = (color_next + 1) % MAX_COLOR_CACHE;
+	if(color_cnt < MAX_COLOR_CACHE)
+		color_cnt++;
+#ifdef DZEN_XFT
+	else
+		XftColorFree(dzen.dpy, DefaultVisual(dzen.dpy, dzen.screen), cmap, &c->xft);
+
+	rc.red   = color.red;
+	rc.green = color.green;
+	rc.blue  = color.blue;
+	rc.alpha = 0xffff;
+	XftColorAllocValue(dzen.dpy, DefaultVisual(dzen.dpy, dzen.screen), cmap, &rc, &c->xft);
+#endif
+	strncpy(c->name, colstr, ARGLEN-1);
+	c->name[ARGLEN-1] = '\0';
+	c->pixel = color.pixel;
+
 	return color.pixel;
 }
 
-void
-setfont(const char *fontstr) {
+#ifdef DZEN_XFT
+XftColor *
+getxftcolor(unsigned long pixel) {
+	static XftColor fallback;
+	XColor color;
+	XRenderColor rc;
+	int i;
+
+	for(i=0; i < color_cnt; i++)
+		if(colors[i].pixel == pixel)
+			return &colors[i].xft;
+
+	/* pixel fell out of the cache, ask the server for its value */
+	ROUNDTRIP();
+	color.pixel = pixel;
+	XQueryColor(dzen.dpy, DefaultColormap(dzen.dpy, dzen.screen), &color);
+	rc.red   = color.red;
+	rc.green = color.green;
+	rc.blue  = color.blue;
+	rc.alpha = 0xffff;
+	fallback.pixel = pixel;
+	fallback.color = rc;
+
+	return &fallback;
+}
+#endif
+
+static int
+loadfont(Fnt *font, const char *fontstr) {
 #ifndef DZEN_XFT
 	char *def, **missing;
 	int i, n;
 
 	missing = NULL;
-	if(dzen.font.set)
-		XFreeFontSet(dzen.dpy, dzen.font.set);
-
-	dzen.font.set = XCreateFontSet(dzen.dpy, fontstr, &missing, &n, &def);
+	font->set = XCreateFontSet(dzen.dpy, fontstr, &missing, &n, &def);
 	if(missing)
 		XFreeStringList(missing);
 
-	if(dzen.font.set) {
-		XFontSetExtents *font_extents;
+	if(font->set) {
 		XFontStruct **xfonts;
 		char **font_names;
-		dzen.font.ascent = dzen.font.descent = 0;
-		font_extents = XExtentsOfFontSet(dzen.font.set);
-		n = XFontsOfFontSet(dzen.font.set, &xfonts, &font_names);
-		for(i = 0, dzen.font.ascent = 0, dzen.font.descent = 0; i < n; i++) {
-			if(dzen.font.ascent < (*xfonts)->ascent)
-				dzen.font.ascent = (*xfonts)->ascent;
-			if(dzen.font.descent < (*xfonts)->descent)
-				dzen.font.descent = (*xfonts)->descent;
+		n = XFontsOfFontSet(font->set, &xfonts, &font_names);
+		for(i = 0, font->ascent = 0, font->descent = 0; i < n; i++) {
+			if(font->ascent < (*xfonts)->ascent)
+				font->ascent = (*xfonts)->ascent;
+			if(font->descent < (*xfonts)->descent)
+				font->descent = (*xfonts)->descent;
 			xfonts++;
 		}
 	}
 	else {
-		if(dzen.font.xfont)
-			XFreeFont(dzen.dpy, dzen.font.xfont);
-		dzen.font.xfont = NULL;
-		if(!(dzen.font.xfont = XLoadQueryFont(dzen.dpy, fontstr)))
-			eprint("dzen: error, cannot load font: '%s'\n", fontstr);
-		dzen.font.ascent = dzen.font.xfont->ascent;
-		dzen.font.descent = dzen.font.xfont->descent;
+		if(!(font->xfont = XLoadQueryFont(dzen.dpy, fontstr)))
+			return 0;
+		font->ascent = font->xfont->ascent;
+		font->descent = font->xfont->descent;
 	}
-	dzen.font.height = dzen.font.ascent + dzen.font.descent;
+	font->height = font->ascent + font->descent;
+#else
+	font->xftfont = XftFontOpenXlfd(dzen.dpy, dzen.screen, fontstr);
+	if(!font->xftfont)
+	   font->xftfont = XftFontOpenName(dzen.dpy, dzen.screen, fontstr);
+	if(!font->xftfont)
+		return 0;
+	font->extents = emalloc(sizeof(XGlyphInfo));
+	XftTextExtentsUtf8(dzen.dpy, font->xftfont, (unsigned const char *) fontstr, strlen(fontstr), font->extents);
+	font->height = font->xftfont->ascent + font->xftfont->descent;
+	font->width = (font->extents->width)/strlen(fontstr);
+#endif
+	return 1;
+}
+
+static int
+samefont(Fnt *a, Fnt *b) {
+#ifndef DZEN_XFT
+	return a->set == b->set && a->xfont == b->xfont;
 #else
-	dzen.font.xftfont = XftFontOpenXlfd(dzen.dpy, dzen.screen, fontstr);
-	if(!dzen.font.xftfont)
-	   dzen.font.xftfont = XftFontOpenName(dzen.dpy, dzen.screen, fontstr);
-	if(!dzen.font.xftfont)
-	   eprint("error, cannot load font: '%s'\n", fontstr);
-	dzen.font.extents = malloc(sizeof(XGlyphInfo));
-	XftTextExtentsUtf8(dzen.dpy, dzen.font.xftfont, (unsigned const char *) fontstr, strlen(fontstr), dzen.font.extents);
-	dzen.font.height = dzen.font.xftfont->ascent + dzen.font.xftfont->descent;
-	dzen.font.width = (dzen.font.extents->width)/strlen(fontstr);
+	return a->xftfont == b->xftfont;
 #endif
 }
 
+static void
+freefont(Fnt *font) {
+	/* a font loaded later may get the same id */
+	memset(widths, 0, sizeof widths);
+#ifndef DZEN_XFT
+	if(font->set)
+		XFreeFontSet(dzen.dpy, font->set);
+	else if(font->xfont)
+		XFreeFont(dzen.dpy, font->xfont);
+#else
+	if(font->xftfont)
+		XftFontClose(dzen.dpy, font->xftfont);
+	free(font->extents);
+#endif
+}
+
+void
+setfont(const char *fontstr) {
+	Fnt font;
+	int i, cached = 0;
+
+	for(i=0; i < font_cnt; i++)
+		if(!strncmp(fonts[i].name, fontstr, ARGLEN)) {
+			dzen.font = fonts[i].f;
+			return;
+		}
+
+	ROUNDTRIP();
+	memset(&font, 0, sizeof font);
+	if(!loadfont(&font, fontstr))
+		eprint("dzen: error, cannot load font: '%s'\n", fontstr);
+
+	/* fonts which did not fit into the cache are owned by dzen.font */
+	for(i=0; i < font_cnt; i++)
+		if(samefont(&fonts[i].f, &dzen.font))
+			cached = 1;
+	if(!cached)
+		freefont(&dzen.font);
+
+	if(font_cnt < MAX_FONT_CACHE) {
+		strncpy(fonts[font_cnt].name, fontstr, ARGLEN-1);
+		fonts[font_cnt].f = font;
+		font_cnt++;
+	}
+	dzen.font = font;
+}
+
 
 int
 get_tokval(const char* line, char **retdata) {
@@ -203,10 +443,16 @@ get_token(const char *line, int * t, char **tval) {
 	return next_pos+off;
 }
 
+/* Lines with ^al() segments are parsed twice, first only to measure
+ * the segments, then to draw them where their widths place them. */
+static int measuring;
+static int seg_w[MAX_SEGMENTS];
+static int seg_cnt;
+
 static void
 setcolor(Drawable *pm, int x, int width, long tfg, long tbg, int reverse, int nobg) {
 
-	if(nobg)
+	if(nobg || measuring)
 		return;
 
 	XSetForeground(dzen.dpy, dzen.tgc, reverse ? tfg : tbg);
@@ -317,6 +563,251 @@ get_block_align_vals(char *s, int *a, int *w)
 }
 
 
+/* ^graph(ID,VALUE[,WxH[,MAX]]): dzen keeps the last W samples of every
+ * graph, so producers only send the newest one */
+typedef struct graph_c {
+	char id[ARGLEN];
+	int w, h, max;
+	int *ring;
+	int head, cnt;
+} graph_c;
+
+/* redrawing a title must not add its samples again */
+static int graph_push = 1;
+
+static graph_c *
+get_graph(char *s, int push) {
+	char id[ARGLEN];
+	int v = 0, w = 50, h = 0, max = 100, i, n;
+	graph_c *g = NULL;
+
+	n = strcspn(s, ",");
+	if(!n || n >= ARGLEN)
+		return NULL;
+	memcpy(id, s, n);
+	id[n] = '\0';
+	if(s[n])
+		sscanf(s+n+1, "%d,%5dx%5d,%d", &v, &w, &h, &max);
+	if(w <= 0 || w > 4096)
+		w = 50;
+	if(h <= 0 || h > dzen.line_height)
+		h = dzen.line_height;
+	if(max <= 0)
+		max = 100;
+
+	for(i=0; i < drawst.graph_cnt; i++)
+		if(!strcmp(drawst.graphs[i].id, id)) {
+			g = &drawst.graphs[i];
+			break;
+		}
+	if(!g) {
+		if(drawst.graph_cnt == MAX_GRAPHS)
+			return NULL;
+		if(!drawst.graphs)
+			drawst.graphs = emalloc(MAX_GRAPHS * sizeof(graph_c));
+		g = &drawst.graphs[drawst.graph_cnt++];
+		strcpy(g->id, id);
+		g->ring = NULL;
+		g->w = 0;
+	}
+	/* a new width starts the graph over */
+	if(g->w != w) {
+		free(g->ring);
+		g->ring = emalloc(w * sizeof(int));
+		g->w = w;
+		g->head = g->cnt = 0;
+	}
+	g->h = h;
+	g->max = max;
+
+	if(push) {
+		g->ring[g->head] = v < 0 ? 0 : v > max ? max : v;
+		g->head = (g->head + 1) % g->w;
+		if(g->cnt < g->w)
+			g->cnt++;
+	}
+	return g;
+}
+
+/* one bar per sample, newest at the right, drawn in a single request */
+static void
+draw_graph(graph_c *g, Drawable pm, int x, int y) {
+	static XRectangle r[4096];	/* the widest graph */
+	int i, n = 0, v, bh;
+
+	for(i=0; i < g->cnt; i++) {
+		v = g->ring[(g->head - g->cnt + i + g->w) % g->w];
+		if(!(bh = v * g->h / g->max))
+			continue;
+		r[n].x = x + g->w - g->cnt + i;
+		r[n].y = y + g->h - bh;
+		r[n].width = 1;
+		r[n].height = bh;
+		n++;
+	}
+	if(n)
+		XFillRectangles(dzen.dpy, pm, dzen.tgc, r, n);
+}
+
+/* ^gauge(VALUE,MIN,MAX,WxH[,STYLE[,SEGW,SEGB[,COLOR]]]), the styles of
+ * gadgets/dbar.c, drawn in at most two requests */
+enum { GaugeNorm, GaugeOutlined, GaugeVertical, GaugePie };
+
+typedef struct {
+	double frac;	/* filled part, 0 to 1 */
+	int w, h;
+	int style;
+	int segw, segb;
+	/* color of the empty part, not drawn if NULL */
+	char *empty;
+} gauge_c;
+
+static int
+get_gauge_vals(char *s, gauge_c *g) {
+	char *f[8];
+	double val, min, max;
+	int n = 0;
+
+	memset(g, 0, sizeof(gauge_c));
+	while(n < 8) {
+		f[n++] = s;
+		if(n == 8 || !(s = strchr(s, ',')))
+			break;
+		*s++ = '\0';
+	}
+	if(n < 4 || sscanf(f[3], "%5dx%5d", &g->w, &g->h) != 2 || g->w <= 0 || g->h <= 0)
+		return 0;
+
+	/* in double, values like memory in KB overflow int arithmetic */
+	val = strtod(f[0], NULL);
+	min = strtod(f[1], NULL);
+	max = strtod(f[2], NULL);
+	g->frac = max > min ? (val - min) / (max - min) : 0;
+	g->frac = g->frac > 0 ? (g->frac < 1 ? g->frac : 1) : 0;
+	if(g->h > dzen.line_height)
+		g->h = dzen.line_height;
+
+	if(n > 4) {
+		if(!strcmp(f[4], "outlined"))
+			g->style = GaugeOutlined;
+		else if(!strcmp(f[4], "vertical"))
+			g->style = GaugeVertical;
+		else if(!strcmp(f[4], "pie"))
+			g->style = GaugePie;
+	}
+	if(n > 6) {
+		g->segw = atoi(f[5]);
+		g->segb = atoi(f[6]);
+	}
+	if(n > 7 && f[7][0])
+		g->empty = f[7];
+	return 1;
+}
+
+/* splits the bar at x,y into rectangles, filled ones go to r, the
+ * rest to e, vertical bars fill from the bottom */
+static void
+gauge_rects(gauge_c *g, int vertical, int x, int y, int w, int h,
+		XRectangle *r, int *nr, XRectangle *e, int *ne) {
+	int len = vertical ? h : w, i, segs, on, l;
+
+	*nr = *ne = 0;
+	if(len <= 0 || (vertical ? w : h) <= 0)
+		return;
+
+	if(g->segw <= 0 || g->segw + g->segb <= 0) {
+		l = g->frac * len;
+		if(vertical) {
+			r[0].x = e[0].x = x;
+			r[0].width = e[0].width = w;
+			e[0].y = y;
+			e[0].height = len - l;
+			r[0].y = y + len - l;
+			r[0].height = l;
+		}
+		else {
+			r[0].y = e[0].y = y;
+			r[0].height = e[0].height = h;
+			r[0].x = x;
+			r[0].width = l;
+			e[0].x = x + l;
+			e[0].width = len - l;
+		}
+		*nr = l > 0;
+		*ne = l < len;
+		return;
+	}
+
+	segs = (len + g->segb) / (g->segw + g->segb);
+	if(segs > MAX_GAUGE_SEGS)
+		segs = MAX_GAUGE_SEGS;
+	on = g->frac * segs;
+	for(i=0; i < segs; i++) {
+		XRectangle *t = i < on ? &r[(*nr)++] : &e[(*ne)++];
+
+		if(vertical) {
+			t->x = x;
+			t->width = w;
+			t->y = y + len - (i+1) * g->segw - i * g->segb;
+			t->height = g->segw;
+		}
+		else {
+			t->x = x + i * (g->segw + g->segb);
+			t->width = g->segw;
+			t->y = y;
+			t->height = h;
+		}
+	}
+}
+
+static void
+draw_gauge(gauge_c *g, Drawable pm, int x, int y, unsigned long fgcol, unsigned long bgcol) {
+	XRectangle r[MAX_GAUGE_SEGS], e[MAX_GAUGE_SEGS];
+	int nr, ne, d;
+	long c;
+	unsigned long ecol = fgcol;
+
+	/* an unknown color leaves the empty part in the background */
+	if(g->empty)
+		ecol = (c = getcolor(g->empty)) != -1 ? (unsigned long)c : bgcol;
+
+	switch(g->style) {
+		case GaugePie:
+			d = g->w < g->h ? g->w : g->h;
+			if(g->empty) {
+				XSetForeground(dzen.dpy, dzen.tgc, ecol);
+				XFillArc(dzen.dpy, pm, dzen.tgc, x, y, d, d, 0, 360*64);
+				XSetForeground(dzen.dpy, dzen.tgc, fgcol);
+			}
+			/* clockwise from twelve o'clock */
+			XFillArc(dzen.dpy, pm, dzen.tgc, x, y, d, d, 90*64,
+					-(int)(g->frac * 360*64));
+			return;
+
+		case GaugeOutlined:
+			XSetForeground(dzen.dpy, dzen.tgc, ecol);
+			XDrawRectangle(dzen.dpy, pm, dzen.tgc, x, y, g->w-1, g->h-1);
+			XSetForeground(dzen.dpy, dzen.tgc, fgcol);
+			gauge_rects(g, 0, x+2, y+2, g->w-4, g->h-4, r, &nr, e, &ne);
+			ne = 0;
+			break;
+
+		default:
+			gauge_rects(g, g->style == GaugeVertical, x, y, g->w, g->h, r, &nr, e, &ne);
+			if(!g->empty)
+				ne = 0;
+			break;
+	}
+
+	if(nr)
+		XFillRectangles(dzen.dpy, pm, dzen.tgc, r, nr);
+	if(ne) {
+		XSetForeground(dzen.dpy, dzen.tgc, ecol);
+		XFillRectangles(dzen.dpy, pm, dzen.tgc, e, ne);
+		XSetForeground(dzen.dpy, dzen.tgc, fgcol);
+	}
+}
+
 static int
 search_icon_cache(const char* name) {
 	int i;
@@ -368,6 +859,8 @@ parse_line(const char *line, int lnr, int align, int reverse, int nodraw) {
 	int block_width = -1;
 	/* clickable area y tracking */
 	int max_y=-1;
+	/* ^al() segments */
+	int seg=0, seg_x=0, lw, segmented=0;
 
 	/* temp buffers */
 	char lbuf[MAX_LINE_LEN], *rbuf = NULL;
@@ -378,6 +871,7 @@ parse_line(const char *line, int lnr, int align, int reverse, int nodraw) {
 
 	/* X stuff */
 	long lastfg = dzen.norm[ColFG], lastbg = dzen.norm[ColBG];
+	long linefg = dzen.norm[ColFG];
 	Fnt *cur_fnt = NULL;
 #ifndef DZEN_XFT
 	XGCValues gcv;
@@ -392,59 +886,57 @@ parse_line(const char *line, int lnr, int align, int reverse, int nodraw) {
 
 #ifdef DZEN_XFT
 	XftDraw *xftd=NULL;
-	XftColor xftc;
-	char *xftcs;
-	int xftcs_f=0;
-	char *xftcs_bg;
-	int xftcs_bgf=0;
-
-	xftcs    = (char *)dzen.fg;
-    xftcs_bg = (char *)dzen.bg;
 #endif
 
 	/* icon cache */
 	int ip;
+	scratch_c *sc;
+	graph_c *gr;
+	gauge_c ga;
 
 	/* parse line and return the text without control commands */
 	if(nodraw) {
 		rbuf = emalloc(MAX_LINE_LEN);
 		rbuf[0] = '\0';
-		if( (lnr + dzen.slave_win.first_line_vis) >= dzen.slave_win.tcnt)
+		/* without text, take the visible slave line lnr */
+		if(line)
+			;
+		else if( (lnr + dzen.slave_win.first_line_vis) >= SLAVE_CNT())
 			line = NULL;
 		else
-			line = dzen.slave_win.tbuf[dzen.slave_win.first_line_vis+lnr];
+			line = slave_text(SLAVE_LINE(dzen.slave_win.first_line_vis+lnr));
 
 	}
 	/* parse line and render text */
 	else {
+		if(!measuring && line && strstr(line, "^al(")) {
+			measuring = 1;
+			seg_cnt = 0;
+			parse_line(line, lnr, align, reverse, 0);
+			measuring = 0;
+			segmented = 1;
+		}
+
 		h = dzen.font.height;
 		py = (dzen.line_height - h) / 2;
-		xorig = 0;
+		drawst.xorig = 0;
 
 
-		if(lnr != -1) {
-			pm = XCreatePixmap(dzen.dpy, RootWindow(dzen.dpy, DefaultScreen(dzen.dpy)), dzen.slave_win.width,
-					dzen.line_height, DefaultDepth(dzen.dpy, dzen.screen));
-		}
+		if(lnr != -1)
+			sc = getscratch(dzen.slave_win.width);
 		else {
-			pm = XCreatePixmap(dzen.dpy, RootWindow(dzen.dpy, DefaultScreen(dzen.dpy)), dzen.title_win.width,
-					dzen.line_height, DefaultDepth(dzen.dpy, dzen.screen));
+			sc = getscratch(dzen.title_win.width);
 			sens_areas_cnt = 0;
 		}
-
+		pm = sc->pm;
 #ifdef DZEN_XFT
-		xftd = XftDrawCreate(dzen.dpy, pm, DefaultVisual(dzen.dpy, dzen.screen), 
-				DefaultColormap(dzen.dpy, dzen.screen));
+		xftd = sc->xftd;
 #endif
 
 		if(!reverse) {
 			XSetForeground(dzen.dpy, dzen.tgc, dzen.norm[ColBG]);
 #ifdef DZEN_XPM
 			xpms.pixel = dzen.norm[ColBG];
-#endif
-#ifdef DZEN_XFT
-			xftcs_bg = (char *)dzen.bg;
-			xftcs_bgf = 0;
 #endif
 		}
 		else {
@@ -453,7 +945,8 @@ parse_line(const char *line, int lnr, int align, int reverse, int nodraw) {
 			xpms.pixel = dzen.norm[ColFG];
 #endif
 		}
-		XFillRectangle(dzen.dpy, pm, dzen.tgc, 0, 0, dzen.w, dzen.h);
+		if(!measuring)
+			XFillRectangle(dzen.dpy, pm, dzen.tgc, 0, 0, dzen.w, dzen.h);
 
 		if(!reverse) {
 			XSetForeground(dzen.dpy, dzen.tgc, dzen.norm[ColFG]);
@@ -482,12 +975,19 @@ parse_line(const char *line, int lnr, int align, int reverse, int nodraw) {
 #endif
 		cur_fnt = &dzen.font;
 
-		if( lnr != -1 && (lnr + dzen.slave_win.first_line_vis >= dzen.slave_win.tcnt)) {
-			XCopyArea(dzen.dpy, pm, dzen.slave_win.drawable[lnr], dzen.gc,
-					0, 0, px, dzen.line_height, xorig, 0);
-			XFreePixmap(dzen.dpy, pm);
+		if( lnr != -1 && (lnr + dzen.slave_win.first_line_vis >= SLAVE_CNT())) {
+			XCopyArea(dzen.dpy, pm, slave_drawable(reverse), dzen.gc,
+					0, 0, px, dzen.line_height, drawst.xorig, slave_row_y(lnr));
 			return NULL;
 		}
+
+		/* slave lines start out in their '-colorize' color */
+		if(lnr != -1 && !reverse && dzen.colorize) {
+			/* history lines are not kept around to be classified at ingest */
+			linefg = lastfg = dzen.slave_win.ishistory ? colorize_line(line) :
+				dzen.slave_win.tcol[SLAVE_LINE(dzen.slave_win.first_line_vis+lnr)];
+			XSetForeground(dzen.dpy, dzen.tgc, lastfg);
+		}
 	}
 
 	linep = line;
@@ -507,11 +1007,12 @@ parse_line(const char *line, int lnr, int align, int reverse, int nodraw) {
 					switch(t) {
 						case icon:
 							if(MAX_ICON_CACHE && (ip=search_icon_cache(tval)) != -1) {
-								int y;
-								XCopyArea(dzen.dpy, icons[ip].p, pm, dzen.tgc,
-										0, 0, icons[ip].w, icons[ip].h, px, y=(set_posy ? py :
+								int y=(set_posy ? py :
 										(dzen.line_height >= (signed)icons[ip].h ?
-										(dzen.line_height - icons[ip].h)/2 : 0)));
+										(dzen.line_height - icons[ip].h)/2 : 0));
+								if(!measuring)
+									XCopyArea(dzen.dpy, icons[ip].p, pm, dzen.tgc,
+											0, 0, icons[ip].w, icons[ip].h, px, y);
 								px += !pos_is_fixed ? icons[ip].w : 0;
 								max_y = MAX(max_y, y+icons[ip].h);
 							} else {
@@ -521,10 +1022,12 @@ parse_line(const char *line, int lnr, int align, int reverse, int nodraw) {
 										&& (h/2 + px + (signed)bm_w < dzen.w)) {
 									setcolor(&pm, px, bm_w, lastfg, lastbg, reverse, nobg);
 
-									XCopyPlane(dzen.dpy, bm, pm, dzen.tgc,
-											0, 0, bm_w, bm_h, px, y=(set_posy ? py :
+									y=(set_posy ? py :
 											(dzen.line_height >= (int)bm_h ?
-												(dzen.line_height - (int)bm_h)/2 : 0)), 1);
+												(dzen.line_height - (int)bm_h)/2 : 0));
+									if(!measuring)
+										XCopyPlane(dzen.dpy, bm, pm, dzen.tgc,
+												0, 0, bm_w, bm_h, px, y, 1);
 									XFreePixmap(dzen.dpy, bm);
 									px += !pos_is_fixed ? bm_w : 0;
 									max_y = MAX(max_y, y+bm_h);
@@ -536,10 +1039,12 @@ parse_line(const char *line, int lnr, int align, int reverse, int nodraw) {
 									if(MAX_ICON_CACHE)
 										cache_icon(tval, xpm_pm, xpma.width, xpma.height);
 
-									XCopyArea(dzen.dpy, xpm_pm, pm, dzen.tgc,
-											0, 0, xpma.width, xpma.height, px, y=(set_posy ? py :
+									y=(set_posy ? py :
 											(dzen.line_height >= (int)xpma.height ?
-												(dzen.line_height - (int)xpma.height)/2 : 0)));
+												(dzen.line_height - (int)xpma.height)/2 : 0));
+									if(!measuring)
+										XCopyArea(dzen.dpy, xpm_pm, pm, dzen.tgc,
+												0, 0, xpma.width, xpma.height, px, y);
 									px += !pos_is_fixed ? xpma.width : 0;
 									max_y = MAX(max_y, y+xpma.height);
 
@@ -562,10 +1067,11 @@ parse_line(const char *line, int lnr, int align, int reverse, int nodraw) {
 							px += !pos_is_fixed ? rectx : 0;
 							setcolor(&pm, px, rectw, lastfg, lastbg, reverse, nobg);
 
-							XFillRectangle(dzen.dpy, pm, dzen.tgc, px,
-									set_posy ? py :
-									((int)recty < 0 ? dzen.line_height + recty : recty),
-									rectw, recth);
+							if(!measuring)
+								XFillRectangle(dzen.dpy, pm, dzen.tgc, px,
+										set_posy ? py :
+										((int)recty < 0 ? dzen.line_height + recty : recty),
+										rectw, recth);
 
 							px += !pos_is_fixed ? rectw : 0;
 							break;
@@ -583,25 +1089,28 @@ parse_line(const char *line, int lnr, int align, int reverse, int nodraw) {
 							/* prevent from stairs effect when rounding recty */
 							if (!((dzen.line_height - recth) % 2)) recty--;
 							setcolor(&pm, px, rectw, lastfg, lastbg, reverse, nobg);
-							XDrawRectangle(dzen.dpy, pm, dzen.tgc, px,
-									set_posy ? py :
-									((int)recty<0 ? dzen.line_height + recty : recty), rectw-1, recth);
+							if(!measuring)
+								XDrawRectangle(dzen.dpy, pm, dzen.tgc, px,
+										set_posy ? py :
+										((int)recty<0 ? dzen.line_height + recty : recty), rectw-1, recth);
 							px += !pos_is_fixed ? rectw : 0;
 							break;
 
 						case circle:
 							rectx = get_circle_vals(tval, &rectw, &recth);
 							setcolor(&pm, px, rectw, lastfg, lastbg, reverse, nobg);
-							XFillArc(dzen.dpy, pm, dzen.tgc, px, set_posy ? py :(dzen.line_height - rectw)/2,
-									rectw, rectw, 90*64, rectx>1?recth*64:64*360);
+							if(!measuring)
+								XFillArc(dzen.dpy, pm, dzen.tgc, px, set_posy ? py :(dzen.line_height - rectw)/2,
+										rectw, rectw, 90*64, rectx>1?recth*64:64*360);
 							px += !pos_is_fixed ? rectw : 0;
 							break;
 
 						case circleo:
 							rectx = get_circle_vals(tval, &rectw, &recth);
 							setcolor(&pm, px, rectw, lastfg, lastbg, reverse, nobg);
-							XDrawArc(dzen.dpy, pm, dzen.tgc, px, set_posy ? py : (dzen.line_height - rectw)/2,
-									rectw, rectw, 90*64, rectx>1?recth*64:64*360);
+							if(!measuring)
+								XDrawArc(dzen.dpy, pm, dzen.tgc, px, set_posy ? py : (dzen.line_height - rectw)/2,
+										rectw, rectw, 90*64, rectx>1?recth*64:64*360);
 							px += !pos_is_fixed ? rectw : 0;
 							break;
 
@@ -675,31 +1184,11 @@ parse_line(const char *line, int lnr, int align, int reverse, int nodraw) {
 
 						case bg:
 							lastbg = tval[0] ? (unsigned)getcolor(tval) : dzen.norm[ColBG];
-#ifdef DZEN_XFT
-							if(xftcs_bgf) free(xftcs_bg);				
-							if(tval[0]) {
-								xftcs_bg = estrdup(tval);
-								xftcs_bgf = 1;
-							} else {
-								xftcs_bg = (char *)dzen.bg;
-								xftcs_bgf = 0;
-							}
-#endif							
-
 							break;
 
 						case fg:
-							lastfg = tval[0] ? (unsigned)getcolor(tval) : dzen.norm[ColFG];
+							lastfg = tval[0] ? (unsigned)getcolor(tval) : linefg;
 							XSetForeground(dzen.dpy, dzen.tgc, lastfg);
-#ifdef DZEN_XFT
-							if(tval[0]) {
-								xftcs = estrdup(tval);
-								xftcs_f = 1;
-							} else {
-								xftcs = (char *)dzen.fg;
-								xftcs_f = 0;
-							}
-#endif							
 							break;
 
 						case fn:
@@ -732,6 +1221,9 @@ parse_line(const char *line, int lnr, int align, int reverse, int nodraw) {
 							font_was_set = 1;
 							break;
 						case ca:
+								/* the highlighted copy of a menu line shares its areas */
+								if((reverse && lnr != -1) || measuring)
+									break;
 								if(tval[0]) {
 									if(sens_areas_cnt < MAX_CLICKABLE_AREAS) {
 										get_sens_area(tval, sens_areas_cnt);
@@ -762,6 +1254,48 @@ parse_line(const char *line, int lnr, int align, int reverse, int nodraw) {
 							else
 								block_align=block_width=-1;
 							break;
+
+						case graph:
+							/* only titles add samples, slave lines are drawn again and again */
+							if(!(gr = get_graph(tval, lnr == -1 && graph_push && !measuring)))
+								break;
+							setcolor(&pm, px, gr->w, lastfg, lastbg, reverse, nobg);
+							if(!measuring)
+								draw_graph(gr, pm, px, set_posy ? py : (dzen.line_height - gr->h)/2);
+							px += !pos_is_fixed ? gr->w : 0;
+							break;
+
+						case gauge:
+							if(!get_gauge_vals(tval, &ga))
+								break;
+							setcolor(&pm, px, ga.w, lastfg, lastbg, reverse, nobg);
+							if(!measuring)
+								draw_gauge(&ga, pm, px, set_posy ? py : (dzen.line_height - ga.h)/2,
+										reverse && !nobg ? lastbg : lastfg,
+										reverse && !nobg ? lastfg : lastbg);
+							px += !pos_is_fixed ? ga.w : 0;
+							break;
+
+						case al:
+							if(measuring) {
+								/* past the limit, the rest is part of the last segment */
+								if(seg_cnt == MAX_SEGMENTS)
+									break;
+								if(seg_cnt)
+									seg_w[seg_cnt-1] = px - seg_x;
+								seg_cnt++;
+								seg_x = px;
+							}
+							else if(seg < seg_cnt) {
+								lw = lnr != -1 ? dzen.slave_win.width : dzen.title_win.width;
+								/* segments never overlap the ones before */
+								if(tval[0] == 'c')
+									px = MAX(px, (lw - seg_w[seg])/2);
+								else if(tval[0] == 'r')
+									px = MAX(px, lw - seg_w[seg]);
+								seg++;
+							}
+							break;
 					}
 					free(tval);
 				}
@@ -776,7 +1310,7 @@ parse_line(const char *line, int lnr, int align, int reverse, int nodraw) {
 				opx = px;
 
 				/* draw background for block */
-				if(block_align!=-1 && !nobg) {
+				if(block_align!=-1 && !nobg && !measuring) {
 					setcolor(&pm, px, rectw, lastbg, lastbg, 0, nobg);
 					XFillRectangle(dzen.dpy, pm, dzen.tgc, px, 0, block_width, dzen.line_height);
 				}
@@ -789,33 +1323,18 @@ parse_line(const char *line, int lnr, int align, int reverse, int nodraw) {
 				if(!nobg)
 					setcolor(&pm, px, tw, lastfg, lastbg, reverse, nobg);
 				
+				if(measuring)
+					;
 #ifndef DZEN_XFT
-				if(cur_fnt->set)
+				else if(cur_fnt->set)
 					XmbDrawString(dzen.dpy, pm, cur_fnt->set,
 							dzen.tgc, px, py + cur_fnt->ascent, lbuf, strlen(lbuf));
 				else
 					XDrawString(dzen.dpy, pm, dzen.tgc, px, py+dzen.font.ascent, lbuf, strlen(lbuf));
 #else
-				if(reverse) {
-				XftColorAllocName(dzen.dpy, DefaultVisual(dzen.dpy, dzen.screen),
-						DefaultColormap(dzen.dpy, dzen.screen),  xftcs_bg,  &xftc);
-				} else {
-				XftColorAllocName(dzen.dpy, DefaultVisual(dzen.dpy, dzen.screen),
-						DefaultColormap(dzen.dpy, dzen.screen),  xftcs,  &xftc);
-				}
-
-				XftDrawStringUtf8(xftd, &xftc, 
-						cur_fnt->xftfont, px, py + dzen.font.xftfont->ascent, (const FcChar8 *)lbuf, strlen(lbuf));
-
-				if(xftcs_f) {
-					free(xftcs);
-					xftcs_f = 0;
-				}
-				if(xftcs_bgf) {
-					free(xftcs_bg);
-					xftcs_bgf = 0;
-				}
-
+				else
+					XftDrawStringUtf8(xftd, getxftcolor(reverse ? lastbg : lastfg),
+							cur_fnt->xftfont, px, py + dzen.font.xftfont->ascent, (const FcChar8 *)lbuf, strlen(lbuf));
 #endif
 
 				max_y = MAX(max_y, py+dzen.font.height);
@@ -833,8 +1352,11 @@ parse_line(const char *line, int lnr, int align, int reverse, int nodraw) {
 				block_align=block_width=-1;
 			}
 
-			if(*linep=='\0')
+			if(*linep=='\0') {
+				if(measuring && seg_cnt)
+					seg_w[seg_cnt-1] = px - seg_x;
 				break;
+			}
 
 			j=0; t=-1; tval=NULL;
 			next_pos = get_token(linep, &t, &tval);
@@ -850,7 +1372,7 @@ parse_line(const char *line, int lnr, int align, int reverse, int nodraw) {
 		linep++;
 	}
 
-	if(!nodraw) {
+	if(!nodraw && !measuring) {
 		/* expand/shrink dynamically */
 		if(dzen.title_win.expand && lnr == -1){
 			i = px;
@@ -866,16 +1388,19 @@ parse_line(const char *line, int lnr, int align, int reverse, int nodraw) {
 					break;
 			}
 
-		} else {
+		/* segments are placed in the window already */
+		} else if(segmented)
+			drawst.xorig = 0;
+		else {
 			if(align == ALIGNLEFT)
-				xorig = 0;
+				drawst.xorig = 0;
 			if(align == ALIGNCENTER) {
-				xorig = (lnr != -1) ?
+				drawst.xorig = (lnr != -1) ?
 					(dzen.slave_win.width - px)/2 :
 					(dzen.title_win.width - px)/2;
 			}
 			else if(align == ALIGNRIGHT) {
-				xorig = (lnr != -1) ?
+				drawst.xorig = (lnr != -1) ?
 					(dzen.slave_win.width - px) :
 					(dzen.title_win.width - px);
 			}
@@ -883,15 +1408,16 @@ parse_line(const char *line, int lnr, int align, int reverse, int nodraw) {
 
 
 		if(lnr != -1) {
-			XCopyArea(dzen.dpy, pm, dzen.slave_win.drawable[lnr], dzen.gc,
-					0, 0, dzen.w, dzen.line_height, xorig, 0);
+			XCopyArea(dzen.dpy, pm, slave_drawable(reverse), dzen.gc,
+					0, 0, dzen.w, dzen.line_height, drawst.xorig, slave_row_y(lnr));
 		}
 		else {
 			XCopyArea(dzen.dpy, pm, dzen.title_win.drawable, dzen.gc,
-					0, 0, dzen.w, dzen.line_height, xorig, 0);
+					0, 0, dzen.w, dzen.line_height, drawst.xorig, 0);
 		}
-		XFreePixmap(dzen.dpy, pm);
+	}
 
+	if(!nodraw) {
 		/* reset font to default */
 		if(font_was_set)
 			setfont(dzen.fnt ? dzen.fnt : FONT);
@@ -902,82 +1428,60 @@ parse_line(const char *line, int lnr, int align, int reverse, int nodraw) {
 			XpmFreeAttributes(&xpma);
 		}
 #endif
-
-#ifdef DZEN_XFT
-		XftDrawDestroy(xftd);
-#endif
 	}
 
 	return nodraw ? rbuf : NULL;
 }
 
-int
-parse_non_drawing_commands(char * text) {
-
-	if(!text)
-		return 1;
-
-	if(!strncmp(text, "^togglecollapse()", strlen("^togglecollapse()"))) {
-		a_togglecollapse(NULL);
-		return 0;
-	}
-	if(!strncmp(text, "^collapse()", strlen("^collapse()"))) {
-		a_collapse(NULL);
-		return 0;
-	}
-	if(!strncmp(text, "^uncollapse()", strlen("^uncollapse()"))) {
-		a_uncollapse(NULL);
-		return 0;
-	}
-
-	if(!strncmp(text, "^togglestick()", strlen("^togglestick()"))) {
-		a_togglestick(NULL);
-		return 0;
-	}
-	if(!strncmp(text, "^stick()", strlen("^stick()"))) {
-		a_stick(NULL);
-		return 0;
-	}
-	if(!strncmp(text, "^unstick()", strlen("^unstick()"))) {
-		a_unstick(NULL);
-		return 0;
-	}
+/* lines consisting of one of these run the action instead of
+ * being displayed */
+static struct {
+	const char *name;
+	handlerf *handler;
+} control_lookup_table[] = {
+	{ "^togglecollapse()", a_togglecollapse },
+	{ "^collapse()",       a_collapse },
+	{ "^uncollapse()",     a_uncollapse },
+	{ "^togglestick()",    a_togglestick },
+	{ "^stick()",          a_stick },
+	{ "^unstick()",        a_unstick },
+	{ "^togglehide()",     a_togglehide },
+	{ "^hide()",           a_hide },
+	{ "^unhide()",         a_unhide },
+	{ "^raise()",          a_raise },
+	{ "^lower()",          a_lower },
+	{ "^scrollhome()",     a_scrollhome },
+	{ "^scrollend()",      a_scrollend },
+	{ "^exit()",           a_exit },
+	{ 0, 0 }
+};
 
-	if(!strncmp(text, "^togglehide()", strlen("^togglehide()"))) {
-		a_togglehide(NULL);
-		return 0;
-	}
-	if(!strncmp(text, "^hide()", strlen("^hide()"))) {
-		a_hide(NULL);
-		return 0;
-	}
-	if(!strncmp(text, "^unhide()", strlen("^unhide()"))) {
-		a_unhide(NULL);
-		return 0;
-	}
+static handlerf *
+get_control_handler(const char *text) {
+	int i;
 
-	if(!strncmp(text, "^raise()", strlen("^raise()"))) {
-		a_raise(NULL);
-		return 0;
-	}
+	if(text[0] != '^')
+		return NULL;
+	for(i=0; control_lookup_table[i].name; i++)
+		if(!strncmp(text, control_lookup_table[i].name, strlen(control_lookup_table[i].name)))
+			return control_lookup_table[i].handler;
+	return NULL;
+}
 
-	if(!strncmp(text, "^lower()", strlen("^lower()"))) {
-		a_lower(NULL);
-		return 0;
-	}
+int
+is_control_line(const char *text) {
+	return text && get_control_handler(text);
+}
 
-	if(!strncmp(text, "^scrollhome()", strlen("^scrollhome()"))) {
-		a_scrollhome(NULL);
-		return 0;
-	}
+int
+parse_non_drawing_commands(char * text) {
+	handlerf *h;
 
-	if(!strncmp(text, "^scrollend()", strlen("^scrollend()"))) {
-		a_scrollend(NULL);
-		return 0;
-	}
+	if(!text)
+		return 1;
 
-	if(!strncmp(text, "^exit()", strlen("^exit()"))) {
-		a_exit(NULL);
+	if((h = get_control_handler(text))) {
+		h(NULL);
 		return 0;
 	}
 
@@ -987,6 +1491,16 @@ parse_non_drawing_commands(char * text) {
 
 void
 drawheader(const char * text) {
+	/* the title is kept to be drawn again, control lines like
+	 * ^togglecollapse() leave it as it is */
+	graph_push = !text || text != dzen.title_win.text;
+	if(text && text != dzen.title_win.text && !is_control_line(text)) {
+		free(dzen.title_win.text);
+		dzen.title_win.text = estrdup(text);
+	}
+	if(text && strstr(text, "^ds("))
+		text = datasrc_expand(text);
+
 	if(parse_non_drawing_commands((char *)text)) {
 		if (text){
 			dzen.w = dzen.title_win.width;
@@ -1004,18 +1518,108 @@ drawheader(const char * text) {
 			dzen.gc, 0, 0, dzen.title_win.width, dzen.line_height, 0, 0);
 }
 
+/* host mode, see x_swap_bar() */
+void
+swap_draw_state(BarState *s) {
+	DrawState t;
+
+	SWAP(drawst, s->draw, t);
+}
+
+static void
+store_line(const char *text) {
+	SWIN *s = &dzen.slave_win;
+
+	s->tbuf[s->tcnt] = intern(text);
+	/* classify once here rather than on every redraw */
+	if(dzen.colorize)
+		s->tcol[s->tcnt] = intern_color(s->tbuf[s->tcnt]);
+	s->tcnt++;
+}
+
+/* the line standing for rep_cnt repeats */
+static void
+repeat_line(char *buf, size_t size) {
+	snprintf(buf, size, "last message repeated %d time%s",
+			drawst.rep_cnt, drawst.rep_cnt == 1 ? "" : "s");
+}
+
+/* history mode: writes the count of repeats still pending, eg. at exit */
+void
+flush_repeats(void) {
+	char buf[64];
+
+	if(!dzen.slave_win.ishistory || !drawst.rep_cnt)
+		return;
+	repeat_line(buf, sizeof buf);
+	if(history_append(buf))
+		dzen.slave_win.tcnt++;
+	drawst.rep_cnt = 0;
+}
+
+/* '-collapse-repeats': a line equal to the one before only counts up
+ * a "last message repeated N times" line, syslog style.  rep_at is
+ * the line count right after the repeated line was stored, rep_text
+ * the line in history mode, where lines are not kept.
+ * Returns 1 if text was absorbed as a repeat. */
+static int
+collapse_repeat(const char *text) {
+	SWIN *s = &dzen.slave_win;
+	char buf[64];
+	int n;
+
+	if(s->ishistory) {
+		/* the history file is append only, so the count is
+		 * written once the repeats end */
+		if(drawst.rep_text && !strcmp(drawst.rep_text, text)) {
+			drawst.rep_cnt++;
+			return 1;
+		}
+		flush_repeats();
+		free(drawst.rep_text);
+		drawst.rep_text = estrdup(text);
+		return 0;
+	}
+
+	n = s->tcnt - (drawst.rep_cnt ? 1 : 0);
+	if(n != drawst.rep_at || n < 1 || strcmp(s->tbuf[n-1], text)
+			|| (!drawst.rep_cnt && s->tcnt == s->tsize)) {
+		drawst.rep_at = s->tcnt + 1;
+		drawst.rep_cnt = 0;
+		return 0;
+	}
+
+	drawst.rep_cnt++;
+	repeat_line(buf, sizeof buf);
+	if(drawst.rep_cnt == 1)
+		store_line(buf);
+	else {
+		unintern(s->tbuf[s->tcnt-1]);
+		s->tcnt--;
+		store_line(buf);
+		x_forget_line(s->tcnt-1);
+		/* the filter has indexed the line as it was */
+		filter_forget(s->tcnt-1);
+	}
+	return 1;
+}
+
 void
 drawbody(char * text) {
 	char *ec;
-	int i, write_buffer=1;
+	int write_buffer=1;
 
 	if(dzen.slave_win.tcnt == -1) {
 		dzen.slave_win.tcnt = 0;
+		free_buffer();
 		drawheader(text);
 		return;
 	}
 
 	if((ec = strstr(text, "^tw()")) && (*(ec-1) != '^')) {
+		/* kept like any title, see drawheader() */
+		free(dzen.title_win.text);
+		dzen.title_win.text = estrdup(ec+5);
 		dzen.w = dzen.title_win.width;
 		dzen.h = dzen.line_height;
 
@@ -1026,23 +1630,36 @@ drawbody(char * text) {
 		return;
 	}
 
-	if(dzen.slave_win.tcnt == dzen.slave_win.tsize)
+	if(dzen.slave_win.tcnt == dzen.slave_win.tsize && !dzen.slave_win.ishistory)
 		free_buffer();
 
 	write_buffer = parse_non_drawing_commands(text);
 
 
 	if(text[0] == '^' && text[1] == 'c' && text[2] == 's') {
+		/* forgets what the pixmap holds, so every row is refilled */
 		free_buffer();
-
-		for(i=0; i < dzen.slave_win.max_lines; i++)
-			XFillRectangle(dzen.dpy, dzen.slave_win.drawable[i], dzen.rgc, 0, 0, dzen.slave_win.width, dzen.line_height);
 		x_draw_body();
 		return;
 	}
 
-	if( write_buffer && (dzen.slave_win.tcnt < dzen.slave_win.tsize) ) {
-		dzen.slave_win.tbuf[dzen.slave_win.tcnt] = estrdup(text);
-		dzen.slave_win.tcnt++;
+	if(write_buffer && dzen.slave_win.collapse_repeats && collapse_repeat(text))
+		return;
+
+	if(dzen.slave_win.ishistory) {
+		if(write_buffer) {
+			if(history_append(text))
+				dzen.slave_win.tcnt++;
+		}
+		return;
+	}
+
+	if(!dzen.slave_win.tbuf) {
+		dzen.slave_win.tbuf = emalloc(dzen.slave_win.tsize * sizeof(char *));
+		if(dzen.colorize)
+			dzen.slave_win.tcol = emalloc(dzen.slave_win.tsize * sizeof(unsigned long));
 	}
+
+	if( write_buffer && (dzen.slave_win.tcnt < dzen.slave_win.tsize) )
+		store_line(text);
 }
@@ -0,0 +1,77 @@
+/*
+ * (C)opyright 2007-2009 Robert Manea <rob dot manea at gmail dot com>
+ * See LICENSE file for license details.
+ *
+ */
+
+/* Shared memory input for dzen, see '-shm' in the README.
+ *
+ * dzen2 -shm /dev/shm/mybar maps that file, creating it if needed, as
+ * a struct dzen_shm.  Producers map the same file and write text into
+ * the slots, the title window shows the text of all slots joined in
+ * slot order.  Only the latest text of every slot is shown, so a
+ * producer may overwrite a slot as often as it likes.
+ *
+ * Writing a slot, as done by dzen_shm_write() below:
+ *
+ *   1. increment seq, it is now odd
+ *   2. write text and len, len < DZEN_SHM_SLOT_LEN, no '\n'
+ *   3. increment seq, it is even again
+ *   4. increment wake, and if waiting is nonzero FUTEX_WAKE the
+ *      futex at wake
+ *
+ * Only one producer may write to a slot at a time.  dzen retries
+ * reading a slot whose seq is odd or changed while it was reading.
+ * Step 4 costs no system call while dzen is busy anyway.
+ */
+
+#ifndef DZEN_SHM_H
+#define DZEN_SHM_H
+
+#include <stdint.h>
+#include <string.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define DZEN_SHM_MAGIC    0x647a6e31	/* "dzn1" */
+#define DZEN_SHM_SLOTS    16
+#define DZEN_SHM_SLOT_LEN 256
+
+struct dzen_shm_slot {
+	uint32_t seq;
+	uint32_t len;
+	char text[DZEN_SHM_SLOT_LEN];
+};
+
+struct dzen_shm {
+	uint32_t magic;
+	uint32_t nslots;
+	uint32_t wake;		/* futex word, bumped after every write */
+	uint32_t waiting;	/* nonzero while dzen sleeps on wake */
+	struct dzen_shm_slot slot[DZEN_SHM_SLOTS];
+};
+
+static inline void
+dzen_shm_write(struct dzen_shm *shm, int n, const char *text) {
+	struct dzen_shm_slot *s = &shm->slot[n];
+	size_t len = strlen(text);
+
+	if(len >= DZEN_SHM_SLOT_LEN)
+		len = DZEN_SHM_SLOT_LEN - 1;
+	__atomic_fetch_add(&s->seq, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(s->text, text, len);
+	__atomic_store_n(&s->len, (uint32_t)len, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&s->seq, 1, __ATOMIC_SEQ_CST);
+
+	__atomic_fetch_add(&shm->wake, 1, __ATOMIC_SEQ_CST);
+#ifdef __linux__
+	if(__atomic_load_n(&shm->waiting, __ATOMIC_SEQ_CST))
+		syscall(SYS_futex, &shm->wake, FUTEX_WAKE, 1, NULL, NULL, 0);
+#endif
+}
+
+#endif
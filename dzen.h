@@ -7,9 +7,14 @@
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/Xresource.h>
+#include <sys/select.h>
+#include <sys/time.h>
 #ifdef DZEN_XINERAMA
 #include <X11/extensions/Xinerama.h>
 #endif
+#ifdef DZEN_XRANDR
+#include <X11/extensions/Xrandr.h>
+#endif
 #ifdef DZEN_XFT
 #include <X11/Xft/Xft.h>
 #endif
@@ -38,6 +43,29 @@
 
 enum { ColFG, ColBG, ColLast };
 
+/* atoms interned in bulk at startup */
+enum { NetWMPid, NetWMStrutPartial, NetWMStrut, NetWMWindowType,
+	NetWMWindowTypeDock, NetWMState, NetWMStateAbove, NetWMStateSticky,
+	NetWMDesktop, AtomLast };
+
+/* counts requests which have to wait for a reply from the X server,
+ * used to check that updates stay free of round trips */
+#ifdef DZEN_DEBUG
+#define ROUNDTRIP()	(dzen.roundtrips++)
+#else
+#define ROUNDTRIP()
+#endif
+
+/* lines shown in the slave window, a menu filter narrows them */
+#define SLAVE_CNT()   (dzen.slave_win.fidx ? dzen.slave_win.fcnt : dzen.slave_win.tcnt)
+#define SLAVE_LINE(n) (dzen.slave_win.fidx ? dzen.slave_win.fidx[n] : (n))
+
+/* exchanges a and b through t */
+#define SWAP(a, b, t) do { t = a; a = b; b = t; } while(0)
+
+/* special dline values */
+enum { LineBlank = -1, LineDirty = -2 };
+
 /* exapansion directions */
 enum { noexpand, left, right, both };
 
@@ -72,7 +100,6 @@ typedef struct _CLICK_A {
 } click_a;
 extern click_a sens_areas[MAX_CLICKABLE_AREAS];
 extern int sens_areas_cnt;
-extern int xorig;
 
 
 /* title window */
@@ -86,16 +113,29 @@ struct TW {
 	int expand;
 	int x_right_corner;
 	Bool ishidden;
+	Bool isdock;
+	/* last title drawn, drawn again when its '^ds()' fields change,
+	 * see datasrc.c, or the window is resized */
+	char *text;
+	/* geometry as requested, before fitting it to the screen */
+	int rx, ry, rwidth;
 };
 
 /* slave window */
 struct SW {
 	int x, y, width, height;
+	/* as requested, see TW */
+	int rx, rwidth;
 
 	char *name;
 	Window win;
-	Window *line;
-	Drawable *drawable;
+	/* one row per line, see slave_row_y() */
+	Drawable drawable;
+	/* input line rendered into each row */
+	int *dline;
+	/* highlighted renderings, menu mode only */
+	Drawable rdrawable;
+	int *rline;
 
 	/* input buffer */
 	char **tbuf; 
@@ -103,6 +143,9 @@ struct SW {
 	int tcnt;
 	/* line fg colors */
 	unsigned long *tcol;
+	/* lines matching the menu filter, NULL if not filtering */
+	int *fidx;
+	int fcnt;
 
 	int max_lines;
 	int first_line_vis;
@@ -114,6 +157,12 @@ struct SW {
 	Bool ishmenu;
 	Bool issticky;
 	Bool ismapped;
+	Bool isfilter;
+	/* lines are kept in a '-history' file instead of tbuf */
+	Bool ishistory;
+	Bool collapse_repeats;
+	/* seconds collapsed before the window is released, 0 keeps it */
+	int idle;
 };
 
 struct DZEN {
@@ -138,6 +187,7 @@ struct DZEN {
 
 	Visual *visual;
 	GC gc, rgc, tgc;
+	Atom atoms[AtomLast];
 	Fnt font;
 	Fnt fnpl[64];
 
@@ -145,17 +195,62 @@ struct DZEN {
 	Bool tsupdate;
 	Bool colorize;
 	unsigned long timeout;
+	Bool input_thread;
 	long cur_line;
 	int ret_val;
 
 	/* should always be 0 if DZEN_XINERAMA not defined */
 	int xinescreen;
+#ifdef DZEN_DEBUG
+	int roundtrips;
+#endif
 };
 
 extern Dzen dzen;
 
+/* what draw.c keeps of the bar being drawn, swapped as a whole in
+ * host mode, so new state only has to be added here */
+typedef struct {
+	int xorig;			/* x offset of the last line drawn */
+	int rep_cnt, rep_at;		/* '-collapse-repeats' */
+	char *rep_text;
+	struct graph_c *graphs;		/* '^graph()' table */
+	int graph_cnt;
+} DrawState;
+
+extern DrawState drawst;
+
+/* what a bar has outside of dzen, swapped in along with it, see host.c */
+typedef struct {
+	/* main.c */
+	XRectangle title_dmg, slave_dmg;
+	XSetWindowAttributes slave_wa;
+	struct timeval slave_release;
+	int hilit_line, body_changed, last_cnt;
+	click_a sens_areas[MAX_CLICKABLE_AREAS];
+	int sens_areas_cnt;
+	/* action.c */
+	void *events;
+	/* draw.c */
+	DrawState draw;
+} BarState;
+
 void free_buffer(void);
 void x_draw_body(void);
+void x_forget_body(void);
+void x_create_slave(void);
+void process_line(char *line);
+void handle_newl(void);
+void x_repaint_damage(void);
+void x_swap_bar(BarState *s);
+const char *slave_text(int n);
+void x_forget_line(int n);
+
+/* datasrc.c */
+extern const char *datasrc_expand(const char *text);	/* fills in the '^ds()' fields of text */
+extern int datasrc_changed(const char *text);	/* true if a field of text changed */
+extern int datasrc_tick(void);			/* samples all sources, true if any changed */
+extern int datasrc_active(void);			/* true if any fields were seen */
 
 /* draw.c */
 extern void drawtext(const char *text,
@@ -167,11 +262,69 @@ extern char * parse_line(const char * text,
 		int align, 
 		int reverse, 
 		int nodraw);
+extern Drawable slave_drawable(int reverse);		/* returns pixmap holding the slave lines */
+extern int slave_row_y(int line);			/* returns offset of visible slave line in it */
 extern long getcolor(const char *colstr);		/* returns color of colstr */
+#ifdef DZEN_XFT
+extern XftColor *getxftcolor(unsigned long pixel);	/* returns Xft color of an allocated pixel */
+#endif
 extern void setfont(const char *fontstr);		/* sets global font */
 extern unsigned int textw(const char *text);	/* returns width of text in px */
 extern void drawheader(const char *text);
 extern void drawbody(char *text);
+extern int is_control_line(const char *text);	/* true if text is an in-band command */
+extern void swap_draw_state(BarState *s);	/* exchanges draw.c's state of a bar */
+extern void flush_repeats(void);		/* writes a pending '-collapse-repeats' count */
+
+/* colorize.c */
+extern void colorize_init(const char *rules);		/* parses '-colorize' rules */
+extern unsigned long colorize_line(const char *text);	/* returns color of a slave line */
+
+/* filter.c */
+extern int filter_key(KeySym ksym, const char *buf, int len);	/* edits the filter query */
+extern void filter_update(void);		/* filters lines read since */
+extern void filter_reset(void);			/* drops the index of emptied input buffer */
+extern void filter_forget(int n);		/* indexes the replaced last slave line n anew */
+
+/* follow.c */
+extern int follow_start(const char *file, int lines, void (*line)(char *));	/* starts reading file */
+extern void follow_read(void);		/* reads what was appended to the file */
+
+/* history.c */
+extern int history_open(const char *path);		/* maps history file, returns its line count */
+extern int history_append(const char *line);	/* adds line to the history file, 0 on failure */
+extern void history_clear(void);			/* hides all lines so far */
+extern const char *history_line(int n);		/* returns line n, valid until the next call */
+
+/* intern.c */
+extern char *intern(const char *s);			/* returns shared copy of s */
+extern void unintern(char *s);				/* releases an interned string */
+extern unsigned long intern_color(const char *s);	/* returns color of an interned string */
+
+/* shm.c */
+extern int shm_start(const char *path);	/* maps the slot table, returns fd to select() on */
+extern int shm_read(char *title);		/* reads changed slots, returns 1 if title changed */
+
+/* control.c */
+extern void control_start(const char *path);	/* listens on the control socket */
+extern void control_stop(void);	/* removes the control socket */
+extern int control_fds(fd_set *rmask, int maxfd);	/* adds client fds, returns highest */
+extern int control_handle(fd_set *rmask);	/* runs commands, returns 1 if lines were added */
+
+/* host.c */
+extern void host_start(const char *file, const char *(*setup)(int argc, char *argv[]));	/* creates the bars */
+extern int host_fds(fd_set *rmask, int maxfd);	/* adds bar input fds, returns highest */
+extern void host_handle(fd_set *rmask);	/* reads bar input */
+extern void host_window(Window win);	/* switches to the bar owning win */
+extern void host_foreach(void (*f)(void));	/* calls f with every bar switched in */
+extern int host_deadline(struct timeval *tv);	/* earliest end of a bar persisting after EOF */
+
+/* input.c */
+extern int input_start(void);		/* starts the reader thread, returns fd to select() on */
+extern void input_ack(void);		/* clears the wakeup of the reader thread */
+extern char *input_pop(void);		/* returns next queued line or NULL */
+extern void input_again(void);		/* wakes up again for lines left over */
+extern int input_eof(void);			/* true once the reader hit EOF */
 
 /* util.c */
 extern void *emalloc(unsigned int size);		/* allocates memory, exits on error */
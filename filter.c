@@ -0,0 +1,270 @@
+/*
+ * (C)opyright 2007-2009 Robert Manea <rob dot manea at gmail dot com>
+ * See LICENSE file for license details.
+ *
+ */
+
+/* Type-to-filter for menus, see '-filter'.
+ *
+ * Keys without an action of their own edit a query, and the slave
+ * window only shows the lines containing it, ignoring case.  The
+ * matching lines are kept in slave_win.fidx, see SLAVE_LINE().
+ *
+ * Lines are indexed the first time a filter runs over them: their
+ * text without formatting commands, and for every trigram in it the
+ * list of lines containing that trigram.  A new query then only needs
+ * to check the lines listed for its rarest trigram, and a query that
+ * extends the previous one only the lines that matched before.
+ */
+
+#include "dzen.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/keysym.h>
+
+#define TRIGRAM_HASH 4096
+#define MAX_QUERY 256
+
+typedef struct trigram_c trigram_c;
+struct trigram_c {
+	unsigned int key;
+	int *lines;
+	int cnt, size;
+	trigram_c *next;
+};
+
+static trigram_c *trigrams[TRIGRAM_HASH];
+static char **stext;	/* stripped, lower cased slave lines */
+static int scnt, ssize;
+static int fsize;
+static char query[MAX_QUERY];
+static int qlen;
+
+static trigram_c *
+gettrigram(unsigned int key, int create) {
+	unsigned int h = (key * 2654435761u) >> 20;
+	trigram_c *t;
+
+	for(t = trigrams[h]; t; t = t->next)
+		if(t->key == key)
+			return t;
+	if(!create)
+		return NULL;
+
+	t = emalloc(sizeof(trigram_c));
+	t->key = key;
+	t->cnt = 0;
+	t->size = 8;
+	t->lines = emalloc(t->size * sizeof(int));
+	t->next = trigrams[h];
+	trigrams[h] = t;
+	return t;
+}
+
+static unsigned int
+trigram_key(const char *s) {
+	return (unsigned char)s[0] << 16 | (unsigned char)s[1] << 8 | (unsigned char)s[2];
+}
+
+/* index slave lines read since the last call */
+static void
+index_lines(void) {
+	trigram_c *t;
+	char *s;
+	int i, j;
+
+	/* history files are not bounded by tsize */
+	if(!ssize || ssize < dzen.slave_win.tcnt) {
+		ssize = dzen.slave_win.tcnt > dzen.slave_win.tsize ?
+			2 * dzen.slave_win.tcnt : dzen.slave_win.tsize;
+		stext = realloc(stext, ssize * sizeof(char *));
+		if(!stext)
+			eprint("fatal: could not realloc() filter index\n");
+	}
+
+	for(i = scnt; i < dzen.slave_win.tcnt; i++) {
+		s = parse_line(slave_text(i), 0, 0, 0, 1);
+		for(j=0; s[j]; j++)
+			s[j] = tolower((unsigned char)s[j]);
+		stext[i] = s;
+
+		for(j=0; s[j] && s[j+1] && s[j+2]; j++) {
+			t = gettrigram(trigram_key(s+j), 1);
+			/* lines are indexed in order, so duplicates are adjacent */
+			if(t->cnt && t->lines[t->cnt-1] == i)
+				continue;
+			if(t->cnt == t->size) {
+				t->size *= 2;
+				t->lines = realloc(t->lines, t->size * sizeof(int));
+				if(!t->lines)
+					eprint("fatal: could not realloc() filter index\n");
+			}
+			t->lines[t->cnt++] = i;
+		}
+	}
+	scnt = dzen.slave_win.tcnt;
+}
+
+static void
+show_top(void) {
+	dzen.slave_win.first_line_vis = 0;
+	dzen.slave_win.last_line_vis  = SLAVE_CNT() < dzen.slave_win.max_lines ?
+		SLAVE_CNT() : dzen.slave_win.max_lines;
+	dzen.slave_win.sel_line = SLAVE_CNT() ? 0 : -1;
+	x_forget_body();
+	x_draw_body();
+}
+
+/* narrow the view to the lines containing the query, extend means
+ * the query grew and the previous result still holds all matches */
+static void
+filter_run(int extend) {
+	trigram_c *t, *best = NULL;
+	int i, n = 0;
+
+	index_lines();
+
+	if(!qlen) {
+		free(dzen.slave_win.fidx);
+		dzen.slave_win.fidx = NULL;
+		dzen.slave_win.fcnt = 0;
+		return;
+	}
+
+	if(!dzen.slave_win.fidx)
+		extend = 0;
+	else if(!extend) {
+		free(dzen.slave_win.fidx);
+		dzen.slave_win.fidx = NULL;
+	}
+
+	if(extend) {
+		for(i=0; i < dzen.slave_win.fcnt; i++)
+			if(strstr(stext[dzen.slave_win.fidx[i]], query))
+				dzen.slave_win.fidx[n++] = dzen.slave_win.fidx[i];
+		dzen.slave_win.fcnt = n;
+		return;
+	}
+
+	fsize = ssize;
+	dzen.slave_win.fidx = emalloc(fsize * sizeof(int));
+	if(qlen >= 3) {
+		/* candidates are the lines with the rarest trigram */
+		for(i=0; i+2 < qlen; i++) {
+			if(!(t = gettrigram(trigram_key(query+i), 0))) {
+				dzen.slave_win.fcnt = 0;
+				return;
+			}
+			if(!best || t->cnt < best->cnt)
+				best = t;
+		}
+		for(i=0; i < best->cnt; i++)
+			if(strstr(stext[best->lines[i]], query))
+				dzen.slave_win.fidx[n++] = best->lines[i];
+	}
+	else {
+		for(i=0; i < scnt; i++)
+			if(strstr(stext[i], query))
+				dzen.slave_win.fidx[n++] = i;
+	}
+	dzen.slave_win.fcnt = n;
+}
+
+/* returns 1 if the key edited the query */
+int
+filter_key(KeySym ksym, const char *buf, int len) {
+	if(ksym == XK_BackSpace) {
+		if(!qlen)
+			return 1;
+		query[--qlen] = '\0';
+		filter_run(0);
+	}
+	else if(ksym == XK_Escape) {
+		if(!qlen)
+			return 0;
+		query[qlen = 0] = '\0';
+		filter_run(0);
+	}
+	else if(len == 1 && isprint((unsigned char)buf[0])) {
+		if(qlen == MAX_QUERY-1)
+			return 1;
+		query[qlen++] = tolower((unsigned char)buf[0]);
+		query[qlen] = '\0';
+		filter_run(1);
+	}
+	else
+		return 0;
+
+	show_top();
+	return 1;
+}
+
+/* new lines were read, add the matching ones to the view */
+void
+filter_update(void) {
+	int i, from = scnt;
+
+	if(!dzen.slave_win.fidx)
+		return;
+
+	index_lines();
+	if(fsize < ssize) {
+		fsize = ssize;
+		dzen.slave_win.fidx = realloc(dzen.slave_win.fidx, fsize * sizeof(int));
+		if(!dzen.slave_win.fidx)
+			eprint("fatal: could not realloc() filter index\n");
+	}
+	for(i = from; i < scnt; i++)
+		if(strstr(stext[i], query))
+			dzen.slave_win.fidx[dzen.slave_win.fcnt++] = i;
+
+	if(dzen.slave_win.last_line_vis < dzen.slave_win.max_lines)
+		dzen.slave_win.last_line_vis = SLAVE_CNT() < dzen.slave_win.max_lines ?
+			SLAVE_CNT() : dzen.slave_win.max_lines;
+	x_draw_body();
+}
+
+/* slave line n, the last one, was replaced */
+void
+filter_forget(int n) {
+	trigram_c *t;
+	char *s;
+	int j;
+
+	if(n < scnt) {
+		/* its trigrams list it last, lines being indexed in order */
+		s = stext[n];
+		for(j=0; s[j] && s[j+1] && s[j+2]; j++)
+			if((t = gettrigram(trigram_key(s+j), 0)) && t->cnt && t->lines[t->cnt-1] == n)
+				t->cnt--;
+		free(s);
+		scnt = n;
+	}
+	if(dzen.slave_win.fidx) {
+		while(dzen.slave_win.fcnt && dzen.slave_win.fidx[dzen.slave_win.fcnt-1] >= n)
+			dzen.slave_win.fcnt--;
+		filter_update();
+	}
+}
+
+/* the input buffer was emptied, line numbers start over */
+void
+filter_reset(void) {
+	trigram_c *t, *next;
+	int i;
+
+	for(i=0; i < scnt; i++)
+		free(stext[i]);
+	scnt = 0;
+	for(i=0; i < TRIGRAM_HASH; i++) {
+		for(t = trigrams[i]; t; t = next) {
+			next = t->next;
+			free(t->lines);
+			free(t);
+		}
+		trigrams[i] = NULL;
+	}
+	dzen.slave_win.fcnt = 0;
+}
@@ -0,0 +1,201 @@
+/*
+ * (C)opyright 2007-2009 Robert Manea <rob dot manea at gmail dot com>
+ * See LICENSE file for license details.
+ *
+ */
+
+/* Reading input from a growing file, see '-follow'.
+ *
+ * Works like 'tail -F': appended data is read as it arrives, a file
+ * truncated in place is read again from its start, and a file replaced
+ * by a new one (log rotation) is read to its end before switching over
+ * to the new one.  On Linux inotify tells when to look, elsewhere the
+ * file is checked once a second.
+ */
+
+#include "dzen.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#define FOLLOW_BLOCK 4096
+
+static const char *path;
+static int fd = -1, nfd = -1, wd = -1, dwd = -1;
+static const char *base;		/* name of the file in its directory */
+static dev_t dev;
+static ino_t ino;
+static off_t pos;
+static char part[MAX_LINE_LEN+1];	/* line read in part so far */
+static int plen;
+static void (*online)(char *);
+
+static void
+split(const char *buf, ssize_t n) {
+	ssize_t i;
+
+	for(i=0; i < n; i++) {
+		/* overlong lines are split, like chomp() does */
+		if(buf[i] == '\n' || plen == MAX_LINE_LEN) {
+			part[plen] = '\0';
+			online(part);
+			plen = 0;
+			if(buf[i] == '\n')
+				continue;
+		}
+		part[plen++] = buf[i];
+	}
+}
+
+static void
+read_new(void) {
+	char buf[FOLLOW_BLOCK];
+	ssize_t n;
+
+	while((n = read(fd, buf, sizeof buf)) > 0) {
+		pos += n;
+		split(buf, n);
+	}
+}
+
+/* offset of the last lines lines of the file, scanning backwards */
+static off_t
+tail_offset(int lines) {
+	char buf[FOLLOW_BLOCK];
+	struct stat st;
+	off_t end, o;
+	ssize_t n, i;
+
+	if(fstat(fd, &st) < 0 || !(end = st.st_size))
+		return 0;
+	if(!lines)
+		return end;
+	/* a final newline does not start another line */
+	if(pread(fd, buf, 1, end-1) == 1 && buf[0] == '\n')
+		end--;
+
+	for(o = end; o > 0; ) {
+		n = o < FOLLOW_BLOCK ? o : FOLLOW_BLOCK;
+		o -= n;
+		if(pread(fd, buf, n, o) != n)
+			return 0;
+		for(i = n-1; i >= 0; i--)
+			if(buf[i] == '\n' && !--lines)
+				return o + i + 1;
+	}
+	return 0;
+}
+
+static int
+open_file(void) {
+	struct stat st;
+
+	if((fd = open(path, O_RDONLY)) < 0)
+		return -1;
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	fstat(fd, &st);
+	dev = st.st_dev;
+	ino = st.st_ino;
+	pos = 0;
+#ifdef __linux__
+	if(nfd >= 0)
+		wd = inotify_add_watch(nfd, path, IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+#endif
+	return 0;
+}
+
+static void
+close_file(void) {
+#ifdef __linux__
+	if(wd >= 0)
+		inotify_rm_watch(nfd, wd);
+	wd = -1;
+#endif
+	close(fd);
+	fd = -1;
+}
+
+/* starts following file, the last lines lines already in it are
+ * passed to line right away.  Returns the descriptor to select() on,
+ * -1 if the file has to be checked periodically. */
+int
+follow_start(const char *file, int lines, void (*line)(char *)) {
+	char *dir;
+
+	path = file;
+	online = line;
+#ifdef __linux__
+	if((nfd = inotify_init()) >= 0) {
+		fcntl(nfd, F_SETFL, fcntl(nfd, F_GETFL) | O_NONBLOCK);
+		fcntl(nfd, F_SETFD, FD_CLOEXEC);
+		/* the directory tells when the file is (re)created */
+		dir = estrdup(file);
+		dwd = inotify_add_watch(nfd, dirname(dir), IN_CREATE | IN_MOVED_TO);
+		free(dir);
+		base = basename(estrdup(file));
+	}
+#else
+	(void)dir;
+#endif
+
+	if(open_file() == 0) {
+		pos = tail_offset(lines);
+		lseek(fd, pos, SEEK_SET);
+		read_new();
+	}
+	return nfd;
+}
+
+/* read whatever changed since the last call */
+void
+follow_read(void) {
+	struct stat st;
+#ifdef __linux__
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event *ev;
+	ssize_t n, i;
+	int seen = nfd < 0;
+
+	/* only events of the file or its name in the directory count, what
+	 * happened is checked anew */
+	while(nfd >= 0 && (n = read(nfd, buf, sizeof buf)) > 0)
+		for(i=0; i < n; i += sizeof *ev + ev->len) {
+			ev = (struct inotify_event *)(buf + i);
+			if(ev->wd != dwd || (ev->len && !strcmp(ev->name, base)))
+				seen = 1;
+		}
+	if(!seen)
+		return;
+#endif
+
+	if(fd >= 0) {
+		read_new();
+
+		/* replaced, the old file has been read to its end */
+		if(stat(path, &st) == 0 && (st.st_dev != dev || st.st_ino != ino)) {
+			close_file();
+			if(plen) {
+				part[plen] = '\0';
+				online(part);
+				plen = 0;
+			}
+		}
+		/* truncated in place */
+		else if(fstat(fd, &st) == 0 && st.st_size < pos) {
+			lseek(fd, 0, SEEK_SET);
+			pos = 0;
+			plen = 0;
+		}
+	}
+	if(fd < 0 && open_file() < 0)
+		return;
+	read_new();
+}
@@ -81,6 +81,6 @@ int main(int argc, char *argv[]) {
       dbar.maxval = dbar.minval;
       dbar.minval = 0;
     }
-    fdbar(&dbar, stdout);
+    wdbar(&dbar, STDOUT_FILENO);
   }
 }
@@ -1,5 +1,79 @@
 #include "dbar.h"
 
+#include <errno.h>
+#include <stdarg.h>
+
+/* output buffer, formatting stops at its end */
+typedef struct {
+	char *p, *end;
+	int full;
+} Out;
+
+static void
+outc(Out *o, char c) {
+	if(o->p < o->end)
+		*o->p++ = c;
+	else
+		o->full = 1;
+}
+
+static void
+outs(Out *o, const char *s) {
+	while(*s)
+		outc(o, *s++);
+}
+
+/* n in decimal, right aligned to at least w characters */
+static void
+outd(Out *o, int n, int w) {
+	char t[16];
+	unsigned int u = n < 0 ? -(unsigned int)n : (unsigned int)n;
+	int i = 0;
+
+	do
+		t[i++] = '0' + u % 10;
+	while(u /= 10);
+	if(n < 0)
+		t[i++] = '-';
+	while(w-- > i)
+		outc(o, ' ');
+	while(i)
+		outc(o, t[--i]);
+}
+
+/* printf() knowing only %s, %d, %3d, %c and %% */
+static void
+outf(Out *o, const char *fmt, ...) {
+	va_list ap;
+
+	va_start(ap, fmt);
+	for(; *fmt; fmt++) {
+		if(*fmt != '%') {
+			outc(o, *fmt);
+			continue;
+		}
+		switch(*++fmt) {
+			case 's':
+				outs(o, va_arg(ap, const char *));
+				break;
+			case 'd':
+				outd(o, va_arg(ap, int), 0);
+				break;
+			case '3':
+				fmt++;
+				outd(o, va_arg(ap, int), 3);
+				break;
+			case 'c':
+				outc(o, (char)va_arg(ap, int));
+				break;
+			case '%':
+				outc(o, '%');
+				break;
+		}
+	}
+	va_end(ap);
+}
+
 void
 dbardefaults(Dbar *dbar, int mode) {
 	dbar->bg	= "darkgrey";
@@ -23,11 +97,18 @@ dbardefaults(Dbar *dbar, int mode) {
 	memset(dbar->gb, '\0', MAX_GRAPH_VALS);
 }
 
-void
-fdbar(Dbar *dbar, FILE *stream) {
-	int i, rp, p, t;
+int
+sdbar(Dbar *dbar, char *buf, int size) {
+	int i, rp, t;
 	int segs, segsa;
 	double l, perc;
+	const char *label = dbar->label ? dbar->label : "";
+	const char *nl = dbar->pnl ? "\n" : "";
+	Out o;
+
+	o.p = buf;
+	o.end = buf + size;
+	o.full = 0;
 
 	perc = (100 * (dbar->val - dbar->minval)) / (dbar->maxval - dbar->minval);
 
@@ -50,132 +131,132 @@ fdbar(Dbar *dbar, FILE *stream) {
 	rp=(int)(perc + 0.5) >= (int)perc ? (int)(perc + 0.5) : (int)perc;
 
 	if(dbar->mode == textual) {
-		fprintf(stream, "%s%3d%% [", dbar->label ? dbar->label : "", rp);
+		outf(&o, "%s%3d%% [", label, rp);
 		for(i=0; i < (int)l; i++)
 			if(i == dbar->width) {
-				fputc('>', stream);
+				outc(&o, '>');
 				break;
 			} else
-				fputc(dbar->sym, stream);
-			for(; i < dbar->width; i++)
-				fputc(' ', stream);
-			fprintf(stream, "]%s", dbar->pnl ? "\n" : "");
+				outc(&o, dbar->sym);
+		for(; i < dbar->width; i++)
+			outc(&o, ' ');
+		outf(&o, "]%s", nl);
 	} else {
 		switch(dbar->style) {
 			case outlined:
 				if(dbar->segb == 0) {
-					fprintf(stream, "%s^ib(1)^fg(%s)^ro(%dx%d)^p(%d)^fg(%s)^r(%dx%d)^p(%d)^ib(0)^fg()%s", 
-							dbar->label ? dbar->label : "",
+					outf(&o, "%s^ib(1)^fg(%s)^ro(%dx%d)^p(%d)^fg(%s)^r(%dx%d)^p(%d)^ib(0)^fg()%s",
+							label,
 							dbar->bg, (int)dbar->width, dbar->height, -1*(dbar->width-2),
 							dbar->fg, (int)l>dbar->width-4?dbar->width-4:(int)l, dbar->height-4>0?dbar->height-4:1,
-							dbar->width-(int)l-1, dbar->pnl ? "\n" : "");
+							dbar->width-(int)l-1, nl);
 				} else {
 					segs  = dbar->width / (dbar->segw + dbar->segb);
 					segsa = rp * segs / 100;
 
-					fprintf(stream, "%s^ib(1)^fg(%s)^ro(%dx%d)^p(%d)", 
-							dbar->label ? dbar->label : "",
+					outf(&o, "%s^ib(1)^fg(%s)^ro(%dx%d)^p(%d)",
+							label,
 							dbar->bg, (int)dbar->width, dbar->height, -1*(dbar->width-2));
-					for(i=0; i < segs; i++) {
-						if(i<segsa)
-							fprintf(stream, "^fg(%s)^r(%dx%d+%d+%d')", dbar->fg, dbar->segw, dbar->height-4>0?dbar->height-4:1, i?dbar->segb:0, 0);
-						else
-							break;
-					}
-					printf("^fg()^ib(0)^p(%d)%s", dbar->width - i*(dbar->segw + dbar->segb), dbar->pnl ? "\n" : "");
+					for(i=0; i < segs && i < segsa; i++)
+						outf(&o, "^fg(%s)^r(%dx%d+%d+%d)", dbar->fg, dbar->segw, dbar->height-4>0?dbar->height-4:1, i?dbar->segb:0, 0);
+					outf(&o, "^fg()^ib(0)^p(%d)%s", dbar->width - i*(dbar->segw + dbar->segb), nl);
 				}
 				break;
 
 			case vertical:
 				segs  = dbar->height / (dbar->segh + dbar->segb);
 				segsa = rp * segs / 100;
-				fprintf(stream, "%s^ib(1)", dbar->label ? dbar->label : "");
+				outf(&o, "%s^ib(1)", label);
 				if(dbar->segb == 0) {
-					//fprintf(stream, "^fg(%s)^r(%dx%d+%d-%d)^fg(%s)^p(-%d)^r(%dx%d+%d-%d)",
-					//		dbar->bg, dbar->segw, dbar->height, 0, dbar->height+1,
-					//		dbar->fg, dbar->segw, dbar->segw, (int)l, 0, (int)l+1);
-					fprintf(stream, "^fg(%s)^r(%dx%d)^fg(%s)^r(%dx%d-%d+%d)",
+					outf(&o, "^fg(%s)^r(%dx%d)^fg(%s)^r(%dx%d-%d+%d)",
 							dbar->bg, dbar->segw, dbar->height,
-							dbar->fg,  
+							dbar->fg,
 							dbar->segw, (int)l, dbar->segw, (int)((dbar->height-l)/2.0 + .5));
 				} else {
 					for(i=0; i < segs; i++) {
 						t = dbar->height/2-(dbar->segh+dbar->segb)*i;
-						//if(i<segsa)
-							fprintf(stream, "^fg(%s)^r(%dx%d-%d%c%d)",
-									i < segsa ? dbar->fg : dbar->bg, dbar->segw, dbar->segh, 
-									i?dbar->segw:0, t > 0 ? '+' : '-', abs(t));
-							//fprintf(stream, "^fg(%s)^p(-%d)^r(%dx%d+%d-%d)",
-							//		dbar->fg, i?dbar->segw:0, dbar->segw,
-							//		dbar->segh, 0, (dbar->segh+dbar->segb)*(i+1));
-						//else
-							//fprintf(stream, "^fg(%s)^r(%dx%d-%d-%d)",
-							//		dbar->bg, dbar->segw,
-							//		dbar->segh,i?dbar->segw:0, (dbar->segh+dbar->segb)*i);
-							//fprintf(stream, "^fg(%s)^p(-%d)^r(%dx%d+%d-%d)",
-							//		dbar->bg, i?dbar->segw:0, dbar->segw,
-							//		dbar->segh, 0, (dbar->segh+dbar->segb)*(i+1));
+						outf(&o, "^fg(%s)^r(%dx%d-%d%c%d)",
+								i < segsa ? dbar->fg : dbar->bg, dbar->segw, dbar->segh,
+								i?dbar->segw:0, t > 0 ? '+' : '-', abs(t));
 					}
 				}
-				fprintf(stream, "^ib(0)^fg()%s", dbar->pnl ? "\n" : "");
+				outf(&o, "^ib(0)^fg()%s", nl);
 				break;
 
 			case graph:
-				dbar->gc = dbar->gc < MAX_GRAPH_VALS && 
+				dbar->gc = dbar->gc+1 < MAX_GRAPH_VALS &&
 					(dbar->gs == 0 ? dbar->gc : dbar->gc * dbar->gs + dbar->gc * dbar->gw)
-					< dbar->width ? ++dbar->gc : 0;
+					< dbar->width ? dbar->gc+1 : 0;
 				dbar->gb[dbar->gc] = l;
 
-				printf("%s", dbar->label ? dbar->label : "");
-				for(i=dbar->gc+1; i<MAX_GRAPH_VALS && (i*(dbar->gs+dbar->gw)) < dbar->width; ++i) {
-					p=100*dbar->gb[i]/dbar->height;
-					p=(int)p+0.5 >= (int)p ? (int)(p+0.5) : (int)p;
-					fprintf(stream, "^fg(%s)^p(%d)^r(%dx%d+0-%d)", 
+				outs(&o, label);
+				for(i=dbar->gc+1; i<MAX_GRAPH_VALS && (i*(dbar->gs+dbar->gw)) < dbar->width; ++i)
+					outf(&o, "^fg(%s)^p(%d)^r(%dx%d+0-%d)",
 							dbar->fg, dbar->gs, dbar->gw, (int)dbar->gb[i], (int)dbar->gb[i]+1);
-				}
 
-				for(i=0; i < dbar->gc; ++i) {
-					p=100*dbar->gb[i]/dbar->height;
-					p=(int)p+0.5 >= (int)p ? (int)(p+0.5) : (int)p;
-					fprintf(stream, "^fg(%s)^p(%d)^r(%dx%d+0-%d)", 
-							dbar->fg, dbar->gs, dbar->gw, (int)dbar->gb[i], (int)dbar->gb[i]+1); 
-				}
-				fprintf(stream, "^fg()%s", dbar->pnl ? "\n" : "");
+				for(i=0; i < dbar->gc; ++i)
+					outf(&o, "^fg(%s)^p(%d)^r(%dx%d+0-%d)",
+							dbar->fg, dbar->gs, dbar->gw, (int)dbar->gb[i], (int)dbar->gb[i]+1);
+				outf(&o, "^fg()%s", nl);
 				break;
 
 			case pie:
-				fprintf(stream, "^ib(1)^fg(%s)^c(%d)^p(-%d)^fg(%s)^c(%d-%d)%s",
-						dbar->bg, dbar->width, dbar->width, 
-						dbar->fg, dbar->width, (int)(rp*360/100),
-						dbar->pnl ? "\n" : "");
+				outf(&o, "^ib(1)^fg(%s)^c(%d)^p(-%d)^fg(%s)^c(%d-%d)%s",
+						dbar->bg, dbar->width, dbar->width,
+						dbar->fg, dbar->width, (int)(rp*360/100), nl);
 				break;
 
 			default:
 				if(dbar->segb == 0)
-					//printf("%s%3d%% ^fg(%s)^r(%dx%d)^fg(%s)^r(%dx%d)^fg()%s", 
-					printf("%s^fg(%s)^r(%dx%d)^fg(%s)^r(%dx%d)^fg()%s", 
-							dbar->label ? dbar->label : "", 
+					outf(&o, "%s^fg(%s)^r(%dx%d)^fg(%s)^r(%dx%d)^fg()%s",
+							label,
 							dbar->fg, (int)l, dbar->height,
-							dbar->bg, dbar->width-(int)l, dbar->height,
-							dbar->pnl ? "\n" : "");
+							dbar->bg, dbar->width-(int)l, dbar->height, nl);
 				else {
 					segs  = dbar->width / (dbar->segw + dbar->segb);
 					segsa = rp * segs / 100;
 
-					//printf("%s%3d%% ", dbar->label ? dbar->label : "", rp);
-					printf("%s", dbar->label ? dbar->label : "");
-					for(i=0; i < segs; i++) {
-						if(i<segsa)
-							fprintf(stream, "^fg(%s)^r(%dx%d+%d+%d)",
-									dbar->fg, dbar->segw, dbar->height, i?dbar->segb:0, 0);
-						else
-							fprintf(stream, "^fg(%s)^r(%dx%d+%d+%d)",
-									dbar->bg, dbar->segw, dbar->height, i?dbar->segb:0, 0);
-					}
-					fprintf(stream, "^p(%d)^fg()%s", dbar->segb, dbar->pnl ? "\n" : "");
+					outs(&o, label);
+					for(i=0; i < segs; i++)
+						outf(&o, "^fg(%s)^r(%dx%d+%d+%d)",
+								i < segsa ? dbar->fg : dbar->bg,
+								dbar->segw, dbar->height, i?dbar->segb:0, 0);
+					outf(&o, "^p(%d)^fg()%s", dbar->segb, nl);
 				}
 				break;
 		}
 	}
+
+	/* a cut off line would leave dzen with half a command */
+	return o.full ? -1 : o.p - buf;
+}
+
+int
+wdbar(Dbar *dbar, int fd) {
+	char buf[DBAR_LEN], *p = buf;
+	int n;
+	ssize_t w;
+
+	if((n = sdbar(dbar, buf, sizeof buf)) < 0)
+		return -1;
+	while(n > 0) {
+		if((w = write(fd, p, n)) < 0) {
+			if(errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += w;
+		n -= w;
+	}
+	return 0;
+}
+
+void
+fdbar(Dbar *dbar, FILE *stream) {
+	char buf[DBAR_LEN];
+	int n;
+
+	if((n = sdbar(dbar, buf, sizeof buf)) > 0)
+		fwrite(buf, 1, n, stream);
 	fflush(stream);
 }
@@ -7,6 +7,8 @@
 #include <string.h>
 
 #define MAX_GRAPH_VALS 1024
+/* longest line formatted, enough for a graph MAX_GRAPH_VALS wide */
+#define DBAR_LEN 65536
 
 typedef struct {
   const char *bg;
@@ -33,6 +35,11 @@ typedef struct {
 enum mode  { textual, graphical };
 enum style { norm, outlined, vertical, graph, pie };
 
+/* formats the bar into buf, returns its length or -1 if it does
+ * not fit */
+int sdbar(Dbar *dbar, char *buf, int size);
+/* writes the bar to fd in a single write(), returns -1 on error */
+int wdbar(Dbar *dbar, int fd);
 void fdbar(Dbar *dbar, FILE *stream);
 void dbardefaults(Dbar *dbar, int mode);
 
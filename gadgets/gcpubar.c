@@ -24,29 +24,137 @@
 
 #include "dbar.h"
 
+#include <fcntl.h>
+
 /* critical % value, color */
 #define CPUCRIT 75
 #define CRITCOL "#D56F6C"
 /* medium % value, color */
 #define CPUMED 50
 #define MEDCOL "#EBA178"
+/* idle % value, below it heatmap cells take the background color */
+#define CPULOW 10
+
+#define MAX_CPUS 512
+/* enough for the cpu lines of MAX_CPUS cores */
+#define STATLEN  65536
 
 struct cpu_info {
 	unsigned long long user;
 	unsigned long long sys;
 	unsigned long long idle;
 	unsigned long long iowait;
-} ncpu, ocpu;
+};
+
+/* [0] is the sum of all cores, [n+1] is core n */
+static struct cpu_info ncpu[MAX_CPUS+1], ocpu[MAX_CPUS+1];
+static char statbuf[STATLEN];
+
+static unsigned long long
+num(const char **p) {
+	unsigned long long n = 0;
+
+	while(**p == ' ')
+		(*p)++;
+	while(**p >= '0' && **p <= '9')
+		n = n * 10 + *(*p)++ - '0';
+	return n;
+}
+
+/* reads all cpu lines of /proc/stat into ncpu, returns the number of
+ * cores or -1 on error */
+static int
+read_stat(int fd) {
+	const char *p = statbuf, *e;
+	ssize_t n;
+	int c, cores = 0;
+
+	if((n = pread(fd, statbuf, sizeof statbuf - 1, 0)) <= 0)
+		return -1;
+	statbuf[n] = '\0';
+
+	/* they come first, a line cut off by the buffer end is left out */
+	while(!strncmp(p, "cpu", 3) && (e = strchr(p, '\n'))) {
+		p += 3;
+		c = *p == ' ' ? 0 : (int)num(&p) + 1;
+		if(c <= MAX_CPUS) {
+			/* linux >= 2.6: user nice system idle iowait */
+			ncpu[c].user   = num(&p);
+			ncpu[c].user  += num(&p);
+			ncpu[c].sys    = num(&p);
+			ncpu[c].idle   = num(&p);
+			ncpu[c].iowait = num(&p);
+			cores = c > cores ? c : cores;
+		}
+		p = e + 1;
+	}
+	return cores ? cores : (ncpu[0].user || ncpu[0].idle ? 0 : -1);
+}
+
+/* busy and total time of cpu c since the last read */
+static void
+load(int c, double *val, double *max) {
+	struct cpu_info m;
+
+	m.user   = ncpu[c].user - ocpu[c].user;
+	m.sys    = ncpu[c].sys - ocpu[c].sys;
+	m.idle   = ncpu[c].idle - ocpu[c].idle;
+	m.iowait = ncpu[c].iowait - ocpu[c].iowait;
+
+	*max = m.user + m.sys + m.idle + m.iowait;
+	*val = m.user + m.sys + m.iowait;
+	if(*max == 0)
+		*max = 1;
+	ocpu[c] = ncpu[c];
+}
+
+static const char *
+heatcol(Dbar *dbar, int perc) {
+	return perc >= CPUCRIT ? CRITCOL :
+		perc >= CPUMED ? MEDCOL :
+		perc >= CPULOW ? dbar->fg : dbar->bg;
+}
+
+/* writes a bar, or heatmap cell, for every core in a single line */
+static void
+write_cores(Dbar *bars, int cores, const char *label, int heat, int space, int pnl) {
+	static char out[DBAR_LEN];
+	/* room left for the end of the line */
+	int lim = sizeof out - 8;
+	int i, n, len;
+
+	/* a label too long is cut off */
+	if((len = snprintf(out, lim, "%s", label ? label : "")) >= lim)
+		len = lim - 1;
+	for(i=0; i < cores && len < lim; i++) {
+		load(i+1, &bars[i].val, &bars[i].maxval);
+		if(heat)
+			n = snprintf(out+len, lim-len, "^fg(%s)^r(%dx%d)",
+					heatcol(&bars[i], (int)(100 * bars[i].val / bars[i].maxval)),
+					bars[i].segw, bars[i].height);
+		else
+			n = sdbar(&bars[i], out+len, lim-len);
+		if(n < 0 || n >= lim-len)
+			break;
+		len += n;
+		if(space && i+1 < cores) {
+			if((n = snprintf(out+len, lim-len, "^p(%d)", space)) >= lim-len)
+				break;
+			len += n;
+		}
+	}
+	len += snprintf(out+len, sizeof out - len, "^fg()%s", pnl ? "\n" : "");
+	if(write(STDOUT_FILENO, out, len) < 0)
+		return;
+}
 
 int main(int argc, char *argv[]) {
-	int i, t;
-	double total;
-	struct cpu_info mcpu;
-	FILE *statfp;
-	char buf[256], *ep;
-	Dbar dbar;
+	int i, t, fd, cores;
+	Dbar dbar, *bars = NULL;
+	char *ep;
 
 	int counts = 0;
+	int percore = 0, heat = 0, space = 2;
 	double ival = 1.0;
 
 	dbardefaults(&dbar, graphical);
@@ -132,43 +240,55 @@ int main(int argc, char *argv[]) {
 		else if(!strncmp(argv[i], "-nonl", 6)) {
 			dbar.pnl = 0;
 		}
+		else if(!strncmp(argv[i], "-C", 3)) {
+			percore = 1;
+		}
+		else if(!strncmp(argv[i], "-H", 3)) {
+			percore = heat = 1;
+		}
+		else if(!strncmp(argv[i], "-cs", 4)) {
+			if(++i < argc)
+				space = atoi(argv[i]);
+		}
 		else {
-			printf("usage: %s [-l <label>] [-i <interval>] [-c <count>] [-fg <color>] [-bg <color>] [-w <pixel>] [-h <pixel>] [-s <o|g|v>] [-sw <pixel>] [-sh <pixel>] [-ss <pixel>] [-gs <pixel>] [-gw <pixel>] [-nonl]\n", argv[0]);
+			printf("usage: %s [-l <label>] [-i <interval>] [-c <count>] [-fg <color>] [-bg <color>] [-w <pixel>] [-h <pixel>] [-s <o|g|v>] [-sw <pixel>] [-sh <pixel>] [-ss <pixel>] [-gs <pixel>] [-gw <pixel>] [-C] [-H] [-cs <pixel>] [-nonl]\n", argv[0]);
 			return EXIT_FAILURE;
 		}
 	}
 
-	if(!(statfp = fopen("/proc/stat", "r"))) {
+	if((fd = open("/proc/stat", O_RDONLY)) < 0 || (cores = read_stat(fd)) < 0) {
 		printf("%s: error opening '/proc/stat'\n", argv[0]);
 		return EXIT_FAILURE;
 	}
 
+	if(percore) {
+		if(!cores) {
+			printf("%s: no cores in '/proc/stat'\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+		/* one bar per core, each keeping its own graph */
+		if(!(bars = malloc(cores * sizeof(Dbar)))) {
+			printf("%s: out of memory\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+		for(i=0; i < cores; i++) {
+			bars[i] = dbar;
+			bars[i].label = NULL;
+			bars[i].pnl = 0;
+		}
+	}
+
 	t = counts > 0 ? counts : 1;
 	while(t) {
-		rewind(statfp); 
-		while(fgets(buf, sizeof buf, statfp)) {
-			if(!strncmp(buf, "cpu ", 4)) {
-				unsigned long long unice;
-				double myload;
-				/* linux >= 2.6 */
-				if((sscanf(buf, "cpu %llu %llu %llu %llu %llu", 
-								&ncpu.user, &unice, &ncpu.sys, &ncpu.idle, &ncpu.iowait)) < 5) {
-					printf("%s: wrong field count in /proc/stat\n", argv[0]);
-					return EXIT_FAILURE;
-				}
-				ncpu.user += unice;
-
-				mcpu.user   = ncpu.user - ocpu.user;
-				mcpu.sys = ncpu.sys - ocpu.sys;
-				mcpu.idle   = ncpu.idle - ocpu.idle;
-				mcpu.iowait = ncpu.iowait - ocpu.iowait;
-
-				dbar.maxval  = mcpu.user + mcpu.sys + mcpu.idle + mcpu.iowait;
-				dbar.val = mcpu.user + mcpu.sys + mcpu.iowait;
-
-				fdbar(&dbar, stdout);
-				ocpu = ncpu;
-			}
+		if(read_stat(fd) < 0) {
+			printf("%s: error reading '/proc/stat'\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+		if(percore)
+			write_cores(bars, cores, dbar.label, heat, space, dbar.pnl);
+		else {
+			load(0, &dbar.val, &dbar.maxval);
+			wdbar(&dbar, STDOUT_FILENO);
 		}
 		if((counts > 0) && (t-1 > 0)) {
 			--t;
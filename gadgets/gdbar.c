@@ -94,7 +94,7 @@ int main(int argc, char *argv[]) {
       dbar.maxval = dbar.minval;
       dbar.minval = 0;
     }
-    fdbar(&dbar, stdout);
+    wdbar(&dbar, STDOUT_FILENO);
   }
 
 }
@@ -28,7 +28,13 @@ THE SOFTWARE.
 #include<string.h>
 #include<X11/Xlib.h>
 
+#define MAX_FONTS   16
+#define MAX_LINE    8192
+#define CACHE_SIZE  1024	/* hash buckets */
+#define MAX_CACHED  8192	/* widths kept before starting over */
+
 typedef struct _Fnt {
+	char *name;
 	XFontStruct *xfont;
 	XFontSet set;
 	int ascent;
@@ -36,58 +42,175 @@ typedef struct _Fnt {
 	int height;
 } Fnt;
 
-Fnt font;
+/* a measured string */
+typedef struct _Width {
+	struct _Width *next;
+	Fnt *font;
+	char *text;
+	unsigned int w;
+} Width;
+
+Fnt fonts[MAX_FONTS];
+int nfonts;
+Fnt *font;
 Display *dpy;
 
+Width *cache[CACHE_SIZE];
+int ncached;
+
 unsigned int
 textw(const char *text, unsigned int len) {
 	XRectangle r;
 
-	if(font.set) {
-		XmbTextExtents(font.set, text, len, NULL, &r);
+	if(font->set) {
+		XmbTextExtents(font->set, text, len, NULL, &r);
 		return r.width;
 	}
-	return XTextWidth(font.xfont, text, len);
+	return XTextWidth(font->xfont, text, len);
 }
 
-void
-setfont(const char *fontstr) {
+/* loads fontstr into f, returns 0 if it does not exist */
+int
+loadfont(Fnt *f, const char *fontstr) {
 	char *def, **missing;
 	int i, n;
 
 	missing = NULL;
-	if(font.set)
-		XFreeFontSet(dpy, font.set);
-	font.set = XCreateFontSet(dpy, fontstr, &missing, &n, &def);
+	f->set = XCreateFontSet(dpy, fontstr, &missing, &n, &def);
 	if(missing)
 		XFreeStringList(missing);
-	if(font.set) {
-		XFontSetExtents *font_extents;
+	if(f->set) {
 		XFontStruct **xfonts;
 		char **font_names;
-		font.ascent = font.descent = 0;
-		font_extents = XExtentsOfFontSet(font.set);
-		n = XFontsOfFontSet(font.set, &xfonts, &font_names);
-		for(i = 0, font.ascent = 0, font.descent = 0; i < n; i++) {
-			if(font.ascent < (*xfonts)->ascent)
-				font.ascent = (*xfonts)->ascent;
-			if(font.descent < (*xfonts)->descent)
-				font.descent = (*xfonts)->descent;
+		n = XFontsOfFontSet(f->set, &xfonts, &font_names);
+		for(i = 0, f->ascent = 0, f->descent = 0; i < n; i++) {
+			if(f->ascent < (*xfonts)->ascent)
+				f->ascent = (*xfonts)->ascent;
+			if(f->descent < (*xfonts)->descent)
+				f->descent = (*xfonts)->descent;
 			xfonts++;
 		}
 	}
 	else {
-		if(font.xfont)
-			XFreeFont(dpy, font.xfont);
-		font.xfont = NULL;
-		if(!(font.xfont = XLoadQueryFont(dpy, fontstr))) {
-			fprintf(stderr, "error, cannot load font: '%s'\n", fontstr);
-			exit(EXIT_FAILURE);
+		if(!(f->xfont = XLoadQueryFont(dpy, fontstr)))
+			return 0;
+		f->ascent = f->xfont->ascent;
+		f->descent = f->xfont->descent;
+	}
+	f->height = f->ascent + f->descent;
+	return 1;
+}
+
+/* switches to fontstr, loading it the first time, returns 0 and keeps
+ * the current font if it cannot be loaded */
+int
+setfont(const char *fontstr) {
+	Fnt *f;
+	int i;
+
+	for(i=0; i < nfonts; i++)
+		if(!strcmp(fonts[i].name, fontstr)) {
+			font = &fonts[i];
+			return 1;
+		}
+
+	if(nfonts == MAX_FONTS) {
+		fprintf(stderr, "error, too many fonts: '%s'\n", fontstr);
+		return 0;
+	}
+	f = &fonts[nfonts];
+	if(!loadfont(f, fontstr)) {
+		fprintf(stderr, "error, cannot load font: '%s'\n", fontstr);
+		return 0;
+	}
+	if(!(f->name = strdup(fontstr))) {
+		fprintf(stderr, "error, out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	nfonts++;
+	font = f;
+	return 1;
+}
+
+static unsigned int
+hash(const char *s) {
+	unsigned int h = 5381;
+
+	while(*s)
+		h = h * 33 + (unsigned char)*s++;
+	return h;
+}
+
+static void
+clear_cache(void) {
+	Width *w, *next;
+	int i;
+
+	for(i=0; i < CACHE_SIZE; i++) {
+		for(w = cache[i]; w; w = next) {
+			next = w->next;
+			free(w->text);
+			free(w);
+		}
+		cache[i] = NULL;
+	}
+	ncached = 0;
+}
+
+/* width of text in the current font, measured once per font */
+unsigned int
+cachedw(const char *text) {
+	unsigned int h = hash(text) % CACHE_SIZE;
+	Width *w;
+
+	for(w = cache[h]; w; w = w->next)
+		if(w->font == font && !strcmp(w->text, text))
+			return w->w;
+
+	if(ncached == MAX_CACHED) {
+		clear_cache();
+		h = hash(text) % CACHE_SIZE;
+	}
+	if(!(w = malloc(sizeof(Width))) || !(w->text = strdup(text))) {
+		fprintf(stderr, "error, out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	w->font = font;
+	w->w = textw(text, strlen(text));
+	w->next = cache[h];
+	cache[h] = w;
+	ncached++;
+	return w->w;
+}
+
+/* reads one string per line and answers each with its width, a line
+ * starting with ^fn(font) switches to font first */
+int
+batch(void) {
+	char line[MAX_LINE], *text, *e;
+	size_t n;
+	int c;
+
+	while(fgets(line, sizeof line, stdin)) {
+		n = strlen(line);
+		if(n && line[n-1] == '\n')
+			line[--n] = '\0';
+		/* an overlong line is measured up to here and answered once */
+		else
+			while((c = getchar()) != EOF && c != '\n')
+				;
+
+		text = line;
+		if(!strncmp(line, "^fn(", 4) && (e = strchr(line, ')'))) {
+			*e = '\0';
+			setfont(line+4);
+			text = e+1;
 		}
-		font.ascent = font.xfont->ascent;
-		font.descent = font.xfont->descent;
+		printf("%u\n", cachedw(text));
+		/* answers are awaited one by one */
+		fflush(stdout);
 	}
-	font.height = font.ascent + font.descent;
+	return EXIT_SUCCESS;
 }
 
 int
@@ -96,12 +219,15 @@ main(int argc, char *argv[])
 	char *myfont, *text;
 
 	if(argc < 3) {
-		fprintf(stderr, "usage: %s <font> <string>\n", argv[0]);
+		fprintf(stderr, "usage: %s <font> <string>\n"
+				"       %s -b <font>\n", argv[0], argv[0]);
 		return EXIT_FAILURE;
 	}
 
 	myfont = argv[1];
 	text   = argv[2];
+	if(!strcmp(argv[1], "-b"))
+		myfont = argv[2];
 
 	dpy = XOpenDisplay(0);
 	if(!dpy) {
@@ -109,9 +235,11 @@ main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
-	setfont(myfont);
+	if(!setfont(myfont))
+		return EXIT_FAILURE;
+	if(!strcmp(argv[1], "-b"))
+		return batch();
 	printf("%u\n", textw(text, strlen(text)));
 
 	return EXIT_SUCCESS;
 }
-
@@ -0,0 +1,131 @@
+/*
+ * (C)opyright 2007-2009 Robert Manea <rob dot manea at gmail dot com>
+ * See LICENSE file for license details.
+ *
+ */
+
+/* File backed slave window history, see '-history'.
+ *
+ * Slave lines are appended to a plain text file instead of being kept
+ * in tbuf.  The file is mapped read-only and an index of line offsets
+ * is kept in memory, rebuilt from the file at startup, so only the
+ * pages holding the lines on screen are ever read.
+ */
+
+#include "dzen.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* the mapping reaches this far past the end of the file, so appended
+ * lines are read without mapping the file again */
+#define MAP_SLACK (1 << 20)
+
+static int fd = -1;
+static char *map;
+static size_t maplen;
+static off_t fsize;
+static off_t *offs;	/* offs[n] is where line n starts, offs[cnt] the end */
+static int cnt, size, base;
+static char lbuf[MAX_LINE_LEN];
+
+static void
+add_offset(off_t o) {
+	if(cnt+1 == size) {
+		size *= 2;
+		offs = realloc(offs, size * sizeof(off_t));
+		if(!offs)
+			eprint("fatal: could not realloc() history index\n");
+	}
+	offs[++cnt] = o;
+}
+
+/* make the mapping cover the whole file and some room to grow */
+static void
+remap(void) {
+	if(map)
+		munmap(map, maplen);
+	map = NULL;
+	maplen = fsize ? fsize + MAP_SLACK : 0;
+	if(maplen && (map = mmap(NULL, maplen, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+		eprint("dzen: cannot map history file\n");
+}
+
+/* returns the number of lines already in the file */
+int
+history_open(const char *path) {
+	struct stat st;
+	char *p, *e;
+
+	if((fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0600)) < 0)
+		eprint("dzen: cannot open history file '%s'\n", path);
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	if(fstat(fd, &st) < 0)
+		eprint("dzen: cannot stat history file '%s'\n", path);
+	fsize = st.st_size;
+	remap();
+
+	size = 1024;
+	offs = emalloc(size * sizeof(off_t));
+	offs[0] = 0;
+	for(p = map, e = map + fsize; p < e; p++)
+		if((p = memchr(p, '\n', e - p)))
+			add_offset(p - map + 1);
+		else
+			break;
+
+	/* complete a line cut short, eg. by a crash */
+	if(fsize && offs[cnt] != fsize) {
+		if(write(fd, "\n", 1) == 1)
+			add_offset(++fsize);
+	}
+	return cnt;
+}
+
+/* returns 0 if the line could not be written */
+int
+history_append(const char *line) {
+	size_t len = strlen(line);
+	char *buf = emalloc(len + 1);
+	int ok;
+
+	memcpy(buf, line, len);
+	buf[len] = '\n';
+	if((ok = write(fd, buf, len + 1) == (ssize_t)(len + 1))) {
+		fsize += len + 1;
+		add_offset(fsize);
+	}
+	/* drop a part written, so the lines after stay whole */
+	else if(ftruncate(fd, fsize) < 0)
+		;
+	free(buf);
+	return ok;
+}
+
+/* lines before the current count are hidden, eg. by ^cs */
+void
+history_clear(void) {
+	base = cnt;
+}
+
+/* returns line n counted from the last clear, valid until the next call */
+const char *
+history_line(int n) {
+	size_t len;
+
+	n += base;
+	if(n < 0 || n >= cnt)
+		return "";
+	if((size_t)offs[n+1] > maplen)
+		remap();
+	len = offs[n+1] - offs[n] - 1;
+	if(len >= sizeof lbuf)
+		len = sizeof lbuf - 1;
+	memcpy(lbuf, map + offs[n], len);
+	lbuf[len] = '\0';
+	return lbuf;
+}
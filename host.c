@@ -0,0 +1,272 @@
+/*
+ * (C)opyright 2007-2009 Robert Manea <rob dot manea at gmail dot com>
+ * See LICENSE file for license details.
+ *
+ */
+
+/* Many bars in one process, see '-host'.
+ *
+ * Every line of the host file holds the options of one bar.  The bars
+ * share the X connection, the font, color and icon caches and the
+ * event loop.  Everything else a bar owns lives in dzen and in the
+ * BarState parts of main.c, action.c and draw.c, all of which is
+ * exchanged with the bar's own copy when switching to another bar, so
+ * the rest of dzen only ever sees a single bar.
+ */
+
+#include "dzen.h"
+#include "action.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define HOST_READS 16	/* reads per bar and select() round, for fairness */
+
+typedef struct {
+	Dzen d;
+	BarState st;
+	int fd;
+	int len;
+	char buf[MAX_LINE_LEN];
+	/* '-p <seconds>' after EOF */
+	struct timeval deadline;
+} Bar;
+
+static Bar **bars;
+static int nbars;
+static Bar *cur;
+
+/* exchanges the bar with the globals */
+static void
+swap_bar(Bar *b) {
+	Dzen t;
+
+	SWAP(dzen, b->d, t);
+	x_swap_bar(&b->st);
+	swap_event_list(&b->st.events);
+	swap_draw_state(&b->st);
+}
+
+static void
+activate(Bar *b) {
+	Bool running = dzen.running;
+	int ret_val = dzen.ret_val;
+
+	if(b == cur)
+		return;
+	if(cur) {
+		x_repaint_damage();
+		swap_bar(cur);
+	}
+	swap_bar(b);
+	cur = b;
+
+	/* an exit action in any bar ends them all */
+	dzen.running = running;
+	dzen.ret_val = ret_val;
+}
+
+/* splits line into words, quotes group words, returns their count */
+static int
+split_words(char *line, char ***argv) {
+	char *p = line, *w, q;
+	int argc = 1, size = 16;
+
+	*argv = emalloc(size * sizeof(char *));
+	(*argv)[0] = "dzen2";
+	for(;;) {
+		while(isspace((unsigned char)*p))
+			p++;
+		if(!*p || *p == '#')
+			break;
+
+		w = p;
+		if(*p == '\'' || *p == '"') {
+			q = *p++;
+			w = p;
+			while(*p && *p != q)
+				p++;
+		}
+		else
+			while(*p && !isspace((unsigned char)*p))
+				p++;
+		if(*p)
+			*p++ = '\0';
+
+		if(argc+1 == size) {
+			size *= 2;
+			if(!(*argv = realloc(*argv, size * sizeof(char *))))
+				eprint("fatal: could not realloc() host options\n");
+		}
+		(*argv)[argc++] = w;
+	}
+	(*argv)[argc] = NULL;
+	return argc;
+}
+
+static int
+open_input(const char *path) {
+	struct stat st;
+	int fd;
+
+	/* a fifo opened for writing too never reads EOF, so writers
+	 * may come and go */
+	if(stat(path, &st) == 0 && S_ISFIFO(st.st_mode))
+		fd = open(path, O_RDWR | O_NONBLOCK);
+	else
+		fd = open(path, O_RDONLY | O_NONBLOCK);
+	if(fd < 0)
+		eprint("dzen: cannot open bar input '%s'\n", path);
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	return fd;
+}
+
+/* creates a bar for every line of file, setup parses the options of
+ * one and returns its input file, if any */
+void
+host_start(const char *file, const char *(*setup)(int argc, char *argv[])) {
+	Dzen template = dzen;
+	char line[MAX_LINE_LEN], **argv;
+	const char *in;
+	FILE *f;
+	Bar *b;
+	int argc;
+
+	if(!(f = fopen(file, "r")))
+		eprint("dzen: cannot open host file '%s'\n", file);
+
+	while(fgets(line, sizeof line, f)) {
+		/* the options are kept for as long as the bar lives */
+		if((argc = split_words(estrdup(line), &argv)) == 1) {
+			free(argv);
+			continue;
+		}
+
+		b = emalloc(sizeof(Bar));
+		memset(b, 0, sizeof(Bar));
+		b->d = template;
+		b->st.hilit_line = -1;
+		b->st.draw.rep_at = -1;
+		b->fd = -1;
+		if(!(nbars % 8) && !(bars = realloc(bars, (nbars+8) * sizeof(Bar *))))
+			eprint("fatal: could not realloc() bars\n");
+		bars[nbars++] = b;
+
+		activate(b);
+		if((in = setup(argc, argv)))
+			b->fd = open_input(in);
+	}
+	fclose(f);
+
+	if(!nbars)
+		eprint("dzen: no bars in host file '%s'\n", file);
+}
+
+int
+host_fds(fd_set *rmask, int maxfd) {
+	int i;
+
+	for(i=0; i < nbars; i++)
+		if(bars[i]->fd >= 0) {
+			FD_SET(bars[i]->fd, rmask);
+			maxfd = maxfd > bars[i]->fd ? maxfd : bars[i]->fd;
+		}
+	return maxfd;
+}
+
+/* reads the input of the current bar, closing it at EOF */
+static void
+read_bar(Bar *b) {
+	char buf[4096];
+	ssize_t n, i;
+	int r;
+
+	for(r=0; r < HOST_READS; r++) {
+		if((n = read(b->fd, buf, sizeof buf)) < 0 && (errno == EAGAIN || errno == EINTR))
+			break;
+		if(n <= 0) {
+			close(b->fd);
+			b->fd = -1;
+			if(b->len) {
+				b->buf[b->len] = '\0';
+				process_line(b->buf);
+				b->len = 0;
+			}
+			/* like a bar of its own, which exits at EOF without '-p' */
+			if(!dzen.ispersistent)
+				dzen.running = False;
+			else if(dzen.timeout > 0) {
+				gettimeofday(&b->deadline, NULL);
+				b->deadline.tv_sec += dzen.timeout;
+			}
+			break;
+		}
+		for(i=0; i < n; i++) {
+			/* overlong lines are split, like chomp() does */
+			if(buf[i] == '\n' || b->len == MAX_LINE_LEN-1) {
+				b->buf[b->len] = '\0';
+				process_line(b->buf);
+				b->len = 0;
+				if(buf[i] == '\n')
+					continue;
+			}
+			b->buf[b->len++] = buf[i];
+		}
+	}
+	handle_newl();
+}
+
+void
+host_handle(fd_set *rmask) {
+	int i;
+
+	for(i=0; i < nbars; i++)
+		if(bars[i]->fd >= 0 && FD_ISSET(bars[i]->fd, rmask)) {
+			activate(bars[i]);
+			read_bar(bars[i]);
+		}
+}
+
+void
+host_window(Window win) {
+	int i;
+
+	if(!win || win == dzen.title_win.win || win == dzen.slave_win.win)
+		return;
+	for(i=0; i < nbars; i++)
+		if(bars[i] != cur
+				&& (win == bars[i]->d.title_win.win || win == bars[i]->d.slave_win.win)) {
+			activate(bars[i]);
+			return;
+		}
+}
+
+/* sets tv to the earliest deadline of a bar, returns 0 if there is none */
+int
+host_deadline(struct timeval *tv) {
+	int i, found = 0;
+
+	for(i=0; i < nbars; i++)
+		if(bars[i]->deadline.tv_sec
+				&& (!found || timercmp(&bars[i]->deadline, tv, <))) {
+			*tv = bars[i]->deadline;
+			found = 1;
+		}
+	return found;
+}
+
+void
+host_foreach(void (*f)(void)) {
+	int i;
+
+	for(i=0; i < nbars; i++) {
+		activate(bars[i]);
+		f();
+	}
+}
@@ -0,0 +1,148 @@
+/*
+ * (C)opyright 2007-2009 Robert Manea <rob dot manea at gmail dot com>
+ * See LICENSE file for license details.
+ *
+ */
+
+/* Optional reader thread, see '-input-thread'.
+ *
+ * The reader splits stdin into lines and hands them to the X thread
+ * through a single-producer/single-consumer ring.  Only the reader
+ * advances head and only the X thread advances tail.  The X thread
+ * sleeps in select() on a wake pipe, which the reader writes to
+ * whenever it finds the X thread caught up with everything before
+ * the line it just queued.
+ */
+
+#include "dzen.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define INPUT_QUEUE_LEN 1024	/* power of two */
+#define INPUT_BACKOFF_MAX 64	/* ms */
+
+static char *queue[INPUT_QUEUE_LEN];
+static unsigned int head, tail;
+static int eof;
+static int wakepipe[2] = { -1, -1 };
+
+static void
+input_wake(void) {
+	char c = 0;
+
+	/* a full pipe already wakes the X thread */
+	if(write(wakepipe[1], &c, 1) < 0)
+		;
+}
+
+/* blocks, with increasing sleeps, while the X thread is behind */
+static void
+input_push(char *line) {
+	struct timespec ts;
+	unsigned int h = __atomic_load_n(&head, __ATOMIC_RELAXED);
+	int ms = 1;
+
+	while(h - __atomic_load_n(&tail, __ATOMIC_SEQ_CST) == INPUT_QUEUE_LEN) {
+		ts.tv_sec = 0;
+		ts.tv_nsec = ms * 1000000L;
+		nanosleep(&ts, NULL);
+		if(ms < INPUT_BACKOFF_MAX)
+			ms *= 2;
+	}
+	queue[h % INPUT_QUEUE_LEN] = line;
+	__atomic_store_n(&head, h+1, __ATOMIC_SEQ_CST);
+
+	/* the X thread saw the queue empty or is about to */
+	if(__atomic_load_n(&tail, __ATOMIC_SEQ_CST) == h)
+		input_wake();
+}
+
+static void *
+input_reader(void *arg) {
+	char buf[MAX_LINE_LEN], line[MAX_LINE_LEN+1];
+	ssize_t n, i;
+	int len = 0;
+
+	(void)arg;
+	for(;;) {
+		n = read(STDIN_FILENO, buf, sizeof buf);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			break;
+		for(i=0; i < n; i++) {
+			/* overlong lines are split, like chomp() does */
+			if(buf[i] == '\n' || len == MAX_LINE_LEN) {
+				line[len] = '\0';
+				input_push(estrdup(line));
+				len = 0;
+				if(buf[i] == '\n')
+					continue;
+			}
+			line[len++] = buf[i];
+		}
+	}
+
+	/* a trailing partial line is dropped, as without the thread */
+	__atomic_store_n(&eof, 1, __ATOMIC_SEQ_CST);
+	input_wake();
+	return NULL;
+}
+
+/* starts the reader, returns the descriptor to select() on */
+int
+input_start(void) {
+	pthread_t tid;
+	int i;
+
+	if(pipe(wakepipe) < 0)
+		eprint("dzen: cannot create input pipe\n");
+	for(i=0; i < 2; i++) {
+		fcntl(wakepipe[i], F_SETFL, fcntl(wakepipe[i], F_GETFL) | O_NONBLOCK);
+		fcntl(wakepipe[i], F_SETFD, FD_CLOEXEC);
+	}
+	if(pthread_create(&tid, NULL, input_reader, NULL))
+		eprint("dzen: cannot create input thread\n");
+	pthread_detach(tid);
+
+	return wakepipe[0];
+}
+
+/* called by the X thread once its select() returned */
+void
+input_ack(void) {
+	char buf[64];
+
+	while(read(wakepipe[0], buf, sizeof buf) > 0)
+		;
+}
+
+/* the next queued line or NULL, the caller frees it */
+char *
+input_pop(void) {
+	unsigned int t = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+	char *line;
+
+	if(__atomic_load_n(&head, __ATOMIC_SEQ_CST) == t)
+		return NULL;
+	line = queue[t % INPUT_QUEUE_LEN];
+	__atomic_store_n(&tail, t+1, __ATOMIC_SEQ_CST);
+	return line;
+}
+
+/* lines left for the next round, keep select() from sleeping */
+void
+input_again(void) {
+	input_wake();
+}
+
+int
+input_eof(void) {
+	return __atomic_load_n(&eof, __ATOMIC_SEQ_CST);
+}
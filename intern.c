@@ -0,0 +1,116 @@
+/*
+ * (C)opyright 2007-2009 Robert Manea <rob dot manea at gmail dot com>
+ * See LICENSE file for license details.
+ *
+ */
+
+/* Reference counted string table for slave lines.
+ *
+ * Log style input repeats the same lines over and over, interning
+ * them keeps a single copy of each text, along with what is derived
+ * from it, like its '-colorize' color.  Interned strings compare
+ * equal if and only if their pointers do.
+ */
+
+#include "dzen.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct istr_c istr_c;
+struct istr_c {
+	istr_c *next;
+	unsigned int hash;
+	int refs;
+	int hascolor;
+	unsigned long color;
+	char str[1];
+};
+
+static istr_c **table;
+static unsigned int tsize, tcnt;
+
+static istr_c *
+entry(const char *s) {
+	return (istr_c *)(s - offsetof(istr_c, str));
+}
+
+static unsigned int
+strhash(const char *s) {
+	unsigned int h = 2166136261u;
+
+	while(*s)
+		h = (h ^ (unsigned char)*s++) * 16777619u;
+	return h;
+}
+
+static void
+grow(void) {
+	istr_c **old = table, *e, *next;
+	unsigned int osize = tsize, i;
+
+	tsize = tsize ? 2 * tsize : 256;
+	table = emalloc(tsize * sizeof(istr_c *));
+	memset(table, 0, tsize * sizeof(istr_c *));
+	for(i=0; i < osize; i++)
+		for(e = old[i]; e; e = next) {
+			next = e->next;
+			e->next = table[e->hash & (tsize-1)];
+			table[e->hash & (tsize-1)] = e;
+		}
+	free(old);
+}
+
+/* returns the shared copy of s, release it with unintern() */
+char *
+intern(const char *s) {
+	unsigned int h = strhash(s);
+	size_t len;
+	istr_c *e;
+
+	if(tsize)
+		for(e = table[h & (tsize-1)]; e; e = e->next)
+			if(e->hash == h && !strcmp(e->str, s)) {
+				e->refs++;
+				return e->str;
+			}
+
+	if(tcnt >= tsize)
+		grow();
+	len = strlen(s);
+	e = emalloc(sizeof(istr_c) + len);
+	memcpy(e->str, s, len + 1);
+	e->hash = h;
+	e->refs = 1;
+	e->hascolor = 0;
+	e->next = table[h & (tsize-1)];
+	table[h & (tsize-1)] = e;
+	tcnt++;
+	return e->str;
+}
+
+void
+unintern(char *s) {
+	istr_c *e = entry(s), **p;
+
+	if(--e->refs)
+		return;
+	for(p = &table[e->hash & (tsize-1)]; *p != e; p = &(*p)->next)
+		;
+	*p = e->next;
+	tcnt--;
+	free(e);
+}
+
+/* '-colorize' color of an interned string, computed once per text */
+unsigned long
+intern_color(const char *s) {
+	istr_c *e = entry(s);
+
+	if(!e->hascolor) {
+		e->color = colorize_line(s);
+		e->hascolor = 1;
+	}
+	return e->color;
+}
@@ -7,6 +7,8 @@
 #include "dzen.h"
 #include "action.h"
 
+#include <X11/Xatom.h>
+
 #include <ctype.h>
 #include <locale.h>
 #include <stdlib.h>
@@ -27,62 +29,74 @@
 Dzen dzen = {0};
 static int last_cnt = 0;
 typedef void sigfunc(int);
+static int sigpipe[2] = { -1, -1 };
+static XRectangle title_dmg, slave_dmg;
+static XSetWindowAttributes slave_wa;
+static struct timeval slave_release;
+static int hilit_line = -1;
+static int body_changed;
+static char *follow;
+static int follow_tail = 10;
+static char *shmpath;
+static char *ctlpath;
+static char *hostfile;
+static int screen_changed;
+#ifdef DZEN_XRANDR
+static int rr_event_base = -1;
+#endif
+/* options only needed while setting up a bar */
+static int use_ewmh_dock;
+static char *action_string, *fnpre, *colorize, *history, *input;
+/* the above as given to dzen2 itself, the defaults of every '-host' bar */
+static int host_dock;
+static char *host_actions, *host_fnpre;
+static void x_destroy_slave(void);
 click_a sens_areas[MAX_CLICKABLE_AREAS];
 int sens_areas_cnt=0;
 
 
+/* frees what the current bar owns */
 static void
-clean_up(void) {
-	int i;
-
+clean_up_bar(void) {
 	free_event_list();
-#ifndef DZEN_XFT
-	if(dzen.font.set)
-		XFreeFontSet(dzen.dpy, dzen.font.set);
-	else
-		XFreeFont(dzen.dpy, dzen.font.xfont);
-#endif
-
 	XFreePixmap(dzen.dpy, dzen.title_win.drawable);
-	if(dzen.slave_win.max_lines) {
-		for(i=0; i < dzen.slave_win.max_lines; i++) {
-			XFreePixmap(dzen.dpy, dzen.slave_win.drawable[i]);
-			XDestroyWindow(dzen.dpy, dzen.slave_win.line[i]);
-		}
-		free(dzen.slave_win.line);
-		XDestroyWindow(dzen.dpy, dzen.slave_win.win);
-	}
+	x_destroy_slave();
 	XFreeGC(dzen.dpy, dzen.gc);
 	XFreeGC(dzen.dpy, dzen.rgc);
 	XFreeGC(dzen.dpy, dzen.tgc);
 	XDestroyWindow(dzen.dpy, dzen.title_win.win);
-	XCloseDisplay(dzen.dpy);
+	free(dzen.title_win.text);
 }
 
 static void
-catch_sigusr1(int s) {
-	(void)s;
-	do_action(sigusr1);
-}
-
-static void
-catch_sigusr2(int s) {
-	(void)s;
-	do_action(sigusr2);
-}
+clean_up(void) {
+#ifndef DZEN_XFT
+	if(dzen.font.set)
+		XFreeFontSet(dzen.dpy, dzen.font.set);
+	else
+		XFreeFont(dzen.dpy, dzen.font.xfont);
+#endif
 
-static void
-catch_sigterm(int s) {
-	(void)s;
-	do_action(onexit);
+	flush_repeats();
+	if(hostfile)
+		host_foreach(clean_up_bar);
+	else
+		clean_up_bar();
+	control_stop();
+	XCloseDisplay(dzen.dpy);
 }
 
+/* signals are only noted here and dispatched synchronously
+ * from the event loop, see handle_signals() */
 static void
-catch_alrm(int s) {
-	(void)s;
-	do_action(onexit);
-	clean_up();
-	exit(0);
+catch_signal(int s) {
+	unsigned char c = (unsigned char)s;
+	int saved_errno = errno;
+
+	/* a full pipe just drops the signal */
+	if(write(sigpipe[1], &c, 1) < 0)
+		;
+	errno = saved_errno;
 }
 
 static sigfunc *
@@ -91,7 +105,7 @@ setup_signal(int signr, sigfunc *shandler) {
 
 	nh.sa_handler = shandler;
 	sigemptyset(&nh.sa_mask);
-	nh.sa_flags = 0;
+	nh.sa_flags = SA_RESTART;
 
 	if(sigaction(signr, &nh, &oh) < 0)
 		return SIG_ERR;
@@ -99,6 +113,66 @@ setup_signal(int signr, sigfunc *shandler) {
 	return NULL;
 }
 
+static void
+setup_signal_pipe(void) {
+	int i;
+
+	if(pipe(sigpipe) < 0)
+		eprint("dzen: cannot create signal pipe\n");
+	for(i=0; i < 2; i++) {
+		fcntl(sigpipe[i], F_SETFL, fcntl(sigpipe[i], F_GETFL) | O_NONBLOCK);
+		fcntl(sigpipe[i], F_SETFD, FD_CLOEXEC);
+	}
+}
+
+static void
+on_sigusr1(void) {
+	do_action(sigusr1);
+}
+
+static void
+on_sigusr2(void) {
+	do_action(sigusr2);
+}
+
+static void
+on_exit_action(void) {
+	do_action(onexit);
+}
+
+static void
+handle_signals(void) {
+	unsigned char buf[64];
+	ssize_t n, i;
+
+	while((n = read(sigpipe[0], buf, sizeof buf)) > 0) {
+		for(i=0; i < n; i++) {
+			switch(buf[i]) {
+				case SIGUSR1:
+					if(hostfile)
+						host_foreach(on_sigusr1);
+					else
+						do_action(sigusr1);
+					break;
+				case SIGUSR2:
+					if(hostfile)
+						host_foreach(on_sigusr2);
+					else
+						do_action(sigusr2);
+					break;
+				case SIGTERM:
+					if(hostfile) {
+						/* all bars go, onexit is run for each below */
+						dzen.running = False;
+						break;
+					}
+					do_action(onexit);
+					break;
+			}
+		}
+	}
+}
+
 char *rem=NULL;
 static int
 chomp(char *inbuf, char *outbuf, int start, int len) {
@@ -130,16 +204,76 @@ chomp(char *inbuf, char *outbuf, int start, int len) {
 	return 0;
 }
 
+/* slave line n, an index into tbuf, was changed in place */
+void
+x_forget_line(int n) {
+	int i;
+
+	for(i=0; i < dzen.slave_win.max_lines; i++) {
+		if(dzen.slave_win.dline[i] >= 0 && dzen.slave_win.dline[i] < SLAVE_CNT()
+				&& SLAVE_LINE(dzen.slave_win.dline[i]) == n)
+			dzen.slave_win.dline[i] = LineDirty;
+		if(dzen.slave_win.rline && dzen.slave_win.rline[i] >= 0
+				&& dzen.slave_win.rline[i] < SLAVE_CNT()
+				&& SLAVE_LINE(dzen.slave_win.rline[i]) == n)
+			dzen.slave_win.rline[i] = LineDirty;
+	}
+	body_changed = 1;
+}
+
+/* returns the text of slave line n, n being an index into tbuf */
+const char *
+slave_text(int n) {
+	if(dzen.slave_win.ishistory)
+		return history_line(n);
+	return dzen.slave_win.tbuf[n];
+}
+
 void
 free_buffer(void) {
 	int i;
-	for(i=0; i<dzen.slave_win.tcnt; i++) {
-		free(dzen.slave_win.tbuf[i]);
+
+	if(dzen.slave_win.ishistory)
+		history_clear();
+	for(i=0; i<dzen.slave_win.tcnt && !dzen.slave_win.ishistory; i++) {
+		unintern(dzen.slave_win.tbuf[i]);
 		dzen.slave_win.tbuf[i] = NULL;
 	}
 	dzen.slave_win.tcnt =
 		dzen.slave_win.last_line_vis =
 		last_cnt = 0;
+	filter_reset();
+	x_forget_body();
+}
+
+/* line numbers are about to be reused, drop what the pixmaps hold */
+void
+x_forget_body(void) {
+	int i;
+
+	for(i=0; i < dzen.slave_win.max_lines && dzen.slave_win.dline; i++)
+		dzen.slave_win.dline[i] = LineDirty;
+	for(i=0; i < dzen.slave_win.max_lines && dzen.slave_win.rline; i++)
+		dzen.slave_win.rline[i] = LineDirty;
+}
+
+/* is the next input line meant for the title window */
+static int
+is_title_line(void) {
+	if(dzen.slave_win.ishmenu)
+		return 0;
+	if(dzen.tsupdate && dzen.slave_win.max_lines)
+		return dzen.cur_line == 0 || !(dzen.cur_line % (dzen.slave_win.max_lines+1));
+	return !dzen.tsupdate && (dzen.cur_line == 0 || !dzen.slave_win.max_lines);
+}
+
+void
+process_line(char *line) {
+	if(is_title_line())
+		drawheader(line);
+	else
+		drawbody(line);
+	dzen.cur_line++;
 }
 
 static int
@@ -157,36 +291,164 @@ read_stdin(void) {
 			return -2;
 	}
 	else {
-		while((n_off = chomp(buf, retbuf, n_off, n))) {
-			if(!dzen.slave_win.ishmenu
-					&& dzen.tsupdate
-					&& dzen.slave_win.max_lines
-					&& ((dzen.cur_line == 0) || !(dzen.cur_line % (dzen.slave_win.max_lines+1))))
-				drawheader(retbuf);
-			else if(!dzen.slave_win.ishmenu
-					&& !dzen.tsupdate
-					&& ((dzen.cur_line == 0) || !dzen.slave_win.max_lines))
-				drawheader(retbuf);
-			else
-				drawbody(retbuf);
+		while((n_off = chomp(buf, retbuf, n_off, n)))
+			process_line(retbuf);
+	}
+	return 0;
+}
+
+/* '-input-thread': take the lines queued by the reader thread,
+ * of several title updates in a row only the last one is drawn */
+static int
+read_queue(void) {
+	char *line, *title = NULL;
+	int n, done;
+
+	input_ack();
+	done = input_eof();
+	for(n=0; n < MIN_BUF_SIZE && (line = input_pop()); n++) {
+		/* control lines act on what is drawn so far and ^tw() draws
+		 * over the title, so a held title goes first */
+		if(title && (is_control_line(line) || strstr(line, "^tw()"))) {
+			drawheader(title);
+			free(title);
+			title = NULL;
+		}
+		if(is_title_line() && !is_control_line(line)) {
+			free(title);
+			title = line;
 			dzen.cur_line++;
+			continue;
+		}
+		process_line(line);
+		free(line);
+	}
+	if(title) {
+		drawheader(title);
+		free(title);
+	}
+
+	if(n == MIN_BUF_SIZE) {
+		input_again();
+		return 0;
+	}
+	if(done) {
+		if(!dzen.ispersistent) {
+			dzen.running = False;
+			return -1;
 		}
+		return -2;
 	}
 	return 0;
 }
 
+/* window area of visible row i */
+static void
+x_row_rect(int i, XRectangle *r) {
+	int ew;
+
+	if(dzen.slave_win.ishmenu) {
+		/* the title width holds the full menu width, see x_create_windows() */
+		ew = dzen.title_win.width / dzen.slave_win.max_lines;
+		r->x = i * ew;
+		r->y = 0;
+		r->width = i == dzen.slave_win.max_lines-1 ? dzen.slave_win.width : ew;
+	}
+	else {
+		r->x = 0;
+		r->y = i * dzen.line_height;
+		r->width = dzen.slave_win.width;
+	}
+	r->height = dzen.line_height;
+}
+
+/* visible row at window position x/y, -1 if none */
+static int
+x_row_at(int x, int y) {
+	int i;
+
+	if(dzen.slave_win.ishmenu) {
+		if(x < 0)
+			return -1;
+		i = x / (dzen.title_win.width / dzen.slave_win.max_lines);
+		if(i >= dzen.slave_win.max_lines)
+			i = dzen.slave_win.max_lines - 1;
+		return i;
+	}
+	if(y < 0 || (i = y / dzen.line_height) >= dzen.slave_win.max_lines)
+		return -1;
+	return i;
+}
+
+static void
+x_copy_row(int i, int reverse) {
+	XRectangle r;
+
+	x_row_rect(i, &r);
+	XCopyArea(dzen.dpy, slave_drawable(reverse), dzen.slave_win.win, dzen.gc,
+			0, slave_row_y(i), r.width, r.height, r.x, r.y);
+}
+
+/* copy visible rows [first, first+n) to the slave window, vertical
+ * windows need at most two copies as the pixmap ring wraps once */
+static void
+x_copy_rows(int first, int n) {
+	int i, k;
+
+	if(dzen.slave_win.ishmenu) {
+		for(i=first; i < first+n; i++)
+			x_copy_row(i, 0);
+	}
+	else {
+		for(i=first; i < first+n; i += k) {
+			k = dzen.slave_win.max_lines - slave_row_y(i) / dzen.line_height;
+			if(k > first+n - i)
+				k = first+n - i;
+			XCopyArea(dzen.dpy, dzen.slave_win.drawable, dzen.slave_win.win, dzen.gc,
+					0, slave_row_y(i), dzen.slave_win.width, k * dzen.line_height,
+					0, i * dzen.line_height);
+		}
+	}
+	if(hilit_line >= first && hilit_line < first+n)
+		x_copy_row(hilit_line, 1);
+}
+
+/* make sure the pixmap of visible row i holds its input line,
+ * rendered highlighted or not */
+static void
+x_render_line(int i, int reverse) {
+	int n = dzen.slave_win.first_line_vis + i;
+	int *dl = reverse ? dzen.slave_win.rline : dzen.slave_win.dline;
+
+	dl += n % dzen.slave_win.max_lines;
+	dzen.w = dzen.slave_win.width;
+	dzen.h = dzen.line_height;
+
+	if(i < dzen.slave_win.last_line_vis && n < SLAVE_CNT()) {
+		if(*dl != n) {
+			drawtext(slave_text(SLAVE_LINE(n)), reverse, i, dzen.slave_win.alignment);
+			*dl = n;
+		}
+	}
+	else if(*dl != LineBlank) {
+		XFillRectangle(dzen.dpy, slave_drawable(reverse), reverse ? dzen.gc : dzen.rgc,
+				0, slave_row_y(i), dzen.w, dzen.h);
+		*dl = LineBlank;
+	}
+}
+
 static void
 x_hilight_line(int line) {
-	drawtext(dzen.slave_win.tbuf[line + dzen.slave_win.first_line_vis], 1, line, dzen.slave_win.alignment);
-	XCopyArea(dzen.dpy, dzen.slave_win.drawable[line], dzen.slave_win.line[line], dzen.gc,
-			0, 0, dzen.slave_win.width, dzen.line_height, 0, 0);
+	x_render_line(line, 1);
+	x_copy_row(line, 1);
+	hilit_line = line;
 }
 
 static void
 x_unhilight_line(int line) {
-	drawtext(dzen.slave_win.tbuf[line + dzen.slave_win.first_line_vis], 0, line, dzen.slave_win.alignment);
-	XCopyArea(dzen.dpy, dzen.slave_win.drawable[line], dzen.slave_win.line[line], dzen.rgc,
-			0, 0, dzen.slave_win.width, dzen.line_height, 0, 0);
+	x_copy_row(line, 0);
+	if(hilit_line == line)
+		hilit_line = -1;
 }
 
 void
@@ -198,24 +460,28 @@ x_draw_body(void) {
 	dzen.h = dzen.line_height;
 
 	if(!dzen.slave_win.last_line_vis) {
-		if(dzen.slave_win.tcnt < dzen.slave_win.max_lines) {
+		if(SLAVE_CNT() < dzen.slave_win.max_lines) {
 			dzen.slave_win.first_line_vis = 0;
-			dzen.slave_win.last_line_vis  = dzen.slave_win.tcnt;
+			dzen.slave_win.last_line_vis  = SLAVE_CNT();
 		}
 		else {
-			dzen.slave_win.first_line_vis = dzen.slave_win.tcnt - dzen.slave_win.max_lines;
-			dzen.slave_win.last_line_vis  = dzen.slave_win.tcnt;
+			dzen.slave_win.first_line_vis = SLAVE_CNT() - dzen.slave_win.max_lines;
+			dzen.slave_win.last_line_vis  = SLAVE_CNT();
 		}
 	}
 
+	/* nothing to draw into, x_draw_body() runs again on MapNotify */
+	if(!dzen.slave_win.ismapped)
+		return;
+
+	/* only render lines which are not already in their pixmap,
+	 * menus render the highlighted variant along with it */
 	for(i=0; i < dzen.slave_win.max_lines; i++) {
-		if(i < dzen.slave_win.last_line_vis)
-			drawtext(dzen.slave_win.tbuf[i + dzen.slave_win.first_line_vis],
-					0, i, dzen.slave_win.alignment);
+		x_render_line(i, 0);
+		if(dzen.slave_win.rdrawable)
+			x_render_line(i, 1);
 	}
-	for(i=0; i < dzen.slave_win.max_lines; i++)
-		XCopyArea(dzen.dpy, dzen.slave_win.drawable[i], dzen.slave_win.line[i], dzen.gc,
-				0, 0, dzen.slave_win.width, dzen.line_height, 0, 0);
+	x_copy_rows(0, dzen.slave_win.max_lines);
 }
 
 static void
@@ -318,8 +584,8 @@ set_docking_ewmh_info(Display *dpy, Window w, int dock) {
 		XChangeProperty(
 				dpy,
 				w,
-				XInternAtom(dpy, "_NET_WM_PID", False),
-				XInternAtom(dpy, "CARDINAL", False),
+				dzen.atoms[NetWMPid],
+				XA_CARDINAL,
 				32,
 				PropModeReplace,
 				(unsigned char *)&cur_pid,
@@ -367,8 +633,8 @@ set_docking_ewmh_info(Display *dpy, Window w, int dock) {
 		XChangeProperty(
 				dpy,
 				w,
-				XInternAtom(dpy, "_NET_WM_STRUT_PARTIAL", False),
-				XInternAtom(dpy, "CARDINAL", False),
+				dzen.atoms[NetWMStrutPartial],
+				XA_CARDINAL,
 				32,
 				PropModeReplace,
 				(unsigned char *)&strut,
@@ -377,8 +643,8 @@ set_docking_ewmh_info(Display *dpy, Window w, int dock) {
 		XChangeProperty(
 				dpy,
 				w,
-				XInternAtom(dpy, "_NET_WM_STRUT", False),
-				XInternAtom(dpy, "CARDINAL", False),
+				dzen.atoms[NetWMStrut],
+				XA_CARDINAL,
 				32,
 				PropModeReplace,
 				(unsigned char *)&strut,
@@ -387,12 +653,12 @@ set_docking_ewmh_info(Display *dpy, Window w, int dock) {
 	}
 
 	if(dock) {
-		type = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_DOCK", False);
+		type = dzen.atoms[NetWMWindowTypeDock];
 		XChangeProperty(
 				dpy,
 				w,
-				XInternAtom(dpy, "_NET_WM_WINDOW_TYPE", False),
-				XInternAtom(dpy, "ATOM", False),
+				dzen.atoms[NetWMWindowType],
+				XA_ATOM,
 				32,
 				PropModeReplace,
 				(unsigned char *)&type,
@@ -400,24 +666,24 @@ set_docking_ewmh_info(Display *dpy, Window w, int dock) {
 				);
 
 		/* some window managers honor this properties*/
-		type = XInternAtom(dpy, "_NET_WM_STATE_ABOVE", False);
+		type = dzen.atoms[NetWMStateAbove];
 		XChangeProperty(
 				dpy,
 				w,
-				XInternAtom(dpy, "_NET_WM_STATE", False),
-				XInternAtom(dpy, "ATOM", False),
+				dzen.atoms[NetWMState],
+				XA_ATOM,
 				32,
 				PropModeReplace,
 				(unsigned char *)&type,
 				1
 				);
 
-		type = XInternAtom(dpy, "_NET_WM_STATE_STICKY", False);
+		type = dzen.atoms[NetWMStateSticky];
 		XChangeProperty(
 				dpy,
 				w,
-				XInternAtom(dpy, "_NET_WM_STATE", False),
-				XInternAtom(dpy, "ATOM", False),
+				dzen.atoms[NetWMState],
+				XA_ATOM,
 				32,
 				PropModeAppend,
 				(unsigned char *)&type,
@@ -429,8 +695,8 @@ set_docking_ewmh_info(Display *dpy, Window w, int dock) {
 		XChangeProperty(
 				dpy,
 				w,
-				XInternAtom(dpy, "_NET_WM_DESKTOP", False),
-				XInternAtom(dpy, "CARDINAL", False),
+				dzen.atoms[NetWMDesktop],
+				XA_CARDINAL,
 				32,
 				PropModeReplace,
 				(unsigned char *)&desktop,
@@ -465,6 +731,18 @@ x_connect(void) {
 	dzen.screen = DefaultScreen(dzen.dpy);
 }
 
+static void
+x_intern_atoms(void) {
+	char *names[AtomLast] = {
+		"_NET_WM_PID", "_NET_WM_STRUT_PARTIAL", "_NET_WM_STRUT",
+		"_NET_WM_WINDOW_TYPE", "_NET_WM_WINDOW_TYPE_DOCK", "_NET_WM_STATE",
+		"_NET_WM_STATE_ABOVE", "_NET_WM_STATE_STICKY", "_NET_WM_DESKTOP"
+	};
+
+	/* a single round trip for all of them */
+	XInternAtoms(dzen.dpy, names, AtomLast, False, dzen.atoms);
+}
+
 /* Read display styles from X resources. */
 static void
 x_read_resources(void) {
@@ -491,13 +769,41 @@ x_read_resources(void) {
 	}
 }
 
+/* place the slave window relative to the fitted title window */
+static void
+x_slave_geometry(XRectangle si) {
+	/* horizontal menu mode */
+	if(dzen.slave_win.ishmenu) {
+		/* calculate width of menuentries - this is a very simple
+		 * approach but works well for general cases.
+		 */
+		int ew = dzen.slave_win.width / dzen.slave_win.max_lines;
+		int r = dzen.slave_win.width - ew * dzen.slave_win.max_lines;
+		dzen.slave_win.y = dzen.title_win.y;
+
+		/* As we don't use the title window in this mode,
+		 * we reuse its width value
+		 */
+		dzen.title_win.width = dzen.slave_win.width;
+		dzen.slave_win.width = ew+r;
+	}
+	else {
+		dzen.slave_win.y = dzen.title_win.y + dzen.line_height;
+
+		if(dzen.title_win.y + dzen.line_height*dzen.slave_win.max_lines > si.y + si.height)
+			dzen.slave_win.y = (dzen.title_win.y - dzen.line_height) - dzen.line_height*(dzen.slave_win.max_lines) + dzen.line_height;
+	}
+}
+
 static void
 x_create_windows(int use_ewmh_dock) {
 	XSetWindowAttributes wa;
 	Window root;
-	int i;
 	XRectangle si;
 	XClassHint *class_hint;
+#ifdef DZEN_XRANDR
+	int i;
+#endif
 
 	root = RootWindow(dzen.dpy, dzen.screen);
 
@@ -513,15 +819,31 @@ x_create_windows(int use_ewmh_dock) {
 	/* window attributes */
 	wa.override_redirect = (use_ewmh_dock ? 0 : 1);
 	wa.background_pixmap = ParentRelative;
-	wa.event_mask = ExposureMask | ButtonReleaseMask | ButtonPressMask | ButtonMotionMask | EnterWindowMask | LeaveWindowMask | KeyPressMask;
+	/* ButtonPress is never handled but selecting it makes the
+	 * implicit grab deliver the matching ButtonRelease to us */
+	wa.event_mask = ExposureMask | ButtonReleaseMask | ButtonPressMask | EnterWindowMask | LeaveWindowMask | KeyPressMask;
 
 #ifdef DZEN_XINERAMA
 	queryscreeninfo(dzen.dpy, &si, dzen.xinescreen);
 #else
 	qsi_no_xinerama(dzen.dpy, &si);
 #endif
+	/* kept for fitting the windows to a changed screen */
+	dzen.title_win.rx = dzen.title_win.x;
+	dzen.title_win.ry = dzen.title_win.y;
+	dzen.title_win.rwidth = dzen.title_win.width;
+	dzen.slave_win.rx = dzen.slave_win.x;
+	dzen.slave_win.rwidth = dzen.slave_win.width;
+	dzen.title_win.isdock = use_ewmh_dock;
 	x_check_geometry(si);
 
+	/* screen size and monitor changes, see x_reconfigure() */
+	XSelectInput(dzen.dpy, root, StructureNotifyMask);
+#ifdef DZEN_XRANDR
+	if(XRRQueryExtension(dzen.dpy, &rr_event_base, &i))
+		XRRSelectInput(dzen.dpy, root, RRScreenChangeNotifyMask);
+#endif
+
 	/* title window */
 	dzen.title_win.win = XCreateWindow(dzen.dpy, root,
 			dzen.title_win.x, dzen.title_win.y, dzen.title_win.width, dzen.line_height, 0,
@@ -550,131 +872,251 @@ x_create_windows(int use_ewmh_dock) {
 	 */
 
 	if(dzen.slave_win.max_lines) {
+		/* map state of the slave window is tracked from Map/UnmapNotify */
+		slave_wa = wa;
+		slave_wa.event_mask |= StructureNotifyMask;
 		dzen.slave_win.first_line_vis = 0;
 		dzen.slave_win.last_line_vis  = 0;
-		dzen.slave_win.line     = emalloc(sizeof(Window) * dzen.slave_win.max_lines);
-		dzen.slave_win.drawable =  emalloc(sizeof(Drawable) * dzen.slave_win.max_lines);
+		dzen.slave_win.dline = emalloc(sizeof(int) * dzen.slave_win.max_lines);
+		if(dzen.slave_win.ismenu) {
+			dzen.slave_win.rline = emalloc(sizeof(int) * dzen.slave_win.max_lines);
+			/* menu entries are hit-tested from the pointer position */
+			slave_wa.event_mask |= PointerMotionMask;
+		}
+
+		x_slave_geometry(si);
 
-		/* horizontal menu mode */
+		/* horizontal menu mode, the menu is always visible */
 		if(dzen.slave_win.ishmenu) {
-			/* calculate width of menuentries - this is a very simple
-			 * approach but works well for general cases.
-			 */
-			int ew = dzen.slave_win.width / dzen.slave_win.max_lines;
-			int r = dzen.slave_win.width - ew * dzen.slave_win.max_lines;
 			dzen.slave_win.issticky = True;
-			dzen.slave_win.y = dzen.title_win.y;
-
-			dzen.slave_win.win = XCreateWindow(dzen.dpy, root,
-					dzen.slave_win.x, dzen.slave_win.y, dzen.slave_win.width, dzen.line_height, 0,
-					DefaultDepth(dzen.dpy, dzen.screen), CopyFromParent,
-					DefaultVisual(dzen.dpy, dzen.screen),
-					CWOverrideRedirect | CWBackPixmap | CWEventMask, &wa);
-			XStoreName(dzen.dpy, dzen.slave_win.win, dzen.slave_win.name);
-
-			for(i=0; i < dzen.slave_win.max_lines; i++) {
-				dzen.slave_win.drawable[i] = XCreatePixmap(dzen.dpy, root, ew+r,
-						dzen.line_height, DefaultDepth(dzen.dpy, dzen.screen));
-			XFillRectangle(dzen.dpy, dzen.slave_win.drawable[i], dzen.rgc, 0, 0,
-					ew+r, dzen.line_height);
-			}
+			x_create_slave();
+		}
+		/* vertical slave window, created when first uncollapsed */
+		else
+			dzen.slave_win.issticky = False;
+	}
 
+}
 
-			/* windows holding the lines */
-			for(i=0; i < dzen.slave_win.max_lines; i++)
-				dzen.slave_win.line[i] = XCreateWindow(dzen.dpy, dzen.slave_win.win,
-						i*ew, 0, (i == dzen.slave_win.max_lines-1) ? ew+r : ew, dzen.line_height, 0,
-						DefaultDepth(dzen.dpy, dzen.screen), CopyFromParent,
-						DefaultVisual(dzen.dpy, dzen.screen),
-						CWOverrideRedirect | CWBackPixmap | CWEventMask, &wa);
+void
+x_create_slave(void) {
+	Window root = RootWindow(dzen.dpy, dzen.screen);
+	int height = dzen.slave_win.max_lines * dzen.line_height;
 
-			/* As we don't use the title window in this mode,
-			 * we reuse its width value
-			 */
-			dzen.title_win.width = dzen.slave_win.width;
-			dzen.slave_win.width = ew+r;
-		}
+	if(dzen.slave_win.win)
+		return;
 
-		/* vertical slave window */
-		else {
-			dzen.slave_win.issticky = False;
-			dzen.slave_win.y = dzen.title_win.y + dzen.line_height;
-
-			if(dzen.title_win.y + dzen.line_height*dzen.slave_win.max_lines > si.y + si.height)
-				dzen.slave_win.y = (dzen.title_win.y - dzen.line_height) - dzen.line_height*(dzen.slave_win.max_lines) + dzen.line_height;
-
-			dzen.slave_win.win = XCreateWindow(dzen.dpy, root,
-					dzen.slave_win.x, dzen.slave_win.y, dzen.slave_win.width, dzen.slave_win.max_lines * dzen.line_height, 0,
-					DefaultDepth(dzen.dpy, dzen.screen), CopyFromParent,
-					DefaultVisual(dzen.dpy, dzen.screen),
-					CWOverrideRedirect | CWBackPixmap | CWEventMask, &wa);
-			XStoreName(dzen.dpy, dzen.slave_win.win, dzen.slave_win.name);
-
-			for(i=0; i < dzen.slave_win.max_lines; i++) {
-				dzen.slave_win.drawable[i] = XCreatePixmap(dzen.dpy, root, dzen.slave_win.width,
-						dzen.line_height, DefaultDepth(dzen.dpy, dzen.screen));
-				XFillRectangle(dzen.dpy, dzen.slave_win.drawable[i], dzen.rgc, 0, 0,
-						dzen.slave_win.width, dzen.line_height);
-			}
+	dzen.slave_win.win = XCreateWindow(dzen.dpy, root,
+			dzen.slave_win.x, dzen.slave_win.y,
+			dzen.slave_win.ishmenu ? dzen.title_win.width : dzen.slave_win.width,
+			dzen.slave_win.ishmenu ? dzen.line_height : height, 0,
+			DefaultDepth(dzen.dpy, dzen.screen), CopyFromParent,
+			DefaultVisual(dzen.dpy, dzen.screen),
+			CWOverrideRedirect | CWBackPixmap | CWEventMask, &slave_wa);
+	XStoreName(dzen.dpy, dzen.slave_win.win, dzen.slave_win.name);
+
+	/* all lines are rendered into one pixmap (two for menus), one
+	 * entry wide and max_lines rows high, see slave_row_y() */
+	dzen.slave_win.drawable = XCreatePixmap(dzen.dpy, root, dzen.slave_win.width,
+			height, DefaultDepth(dzen.dpy, dzen.screen));
+	if(dzen.slave_win.ismenu)
+		dzen.slave_win.rdrawable = XCreatePixmap(dzen.dpy, root, dzen.slave_win.width,
+				height, DefaultDepth(dzen.dpy, dzen.screen));
+	x_forget_body();
+}
+
+/* give the slave window back to the server, it is recreated
+ * on the next uncollapse */
+static void
+x_destroy_slave(void) {
+	slave_release.tv_sec = 0;
+	if(!dzen.slave_win.win)
+		return;
+
+	XDestroyWindow(dzen.dpy, dzen.slave_win.win);
+	XFreePixmap(dzen.dpy, dzen.slave_win.drawable);
+	if(dzen.slave_win.rdrawable)
+		XFreePixmap(dzen.dpy, dzen.slave_win.rdrawable);
+	dzen.slave_win.win = 0;
+	dzen.slave_win.drawable = dzen.slave_win.rdrawable = 0;
+	dzen.slave_win.ismapped = False;
+	slave_dmg.width = 0;
+	hilit_line = -1;
+}
+
+/* the screen changed size or monitors came and went: fit the windows
+ * to it again and resize their pixmaps, without recreating them */
+static void
+x_reconfigure(void) {
+	Window root = RootWindow(dzen.dpy, dzen.screen);
+	TWIN *t = &dzen.title_win;
+	SWIN *s = &dzen.slave_win;
+	XRectangle si;
+	Pixmap pm;
 
-			/* windows holding the lines */
-			for(i=0; i < dzen.slave_win.max_lines; i++)
-				dzen.slave_win.line[i] = XCreateWindow(dzen.dpy, dzen.slave_win.win,
-						0, i*dzen.line_height, dzen.slave_win.width, dzen.line_height, 0,
-						DefaultDepth(dzen.dpy, dzen.screen), CopyFromParent,
-						DefaultVisual(dzen.dpy, dzen.screen),
-						CWOverrideRedirect | CWBackPixmap | CWEventMask, &wa);
+#ifdef DZEN_XINERAMA
+	queryscreeninfo(dzen.dpy, &si, dzen.xinescreen);
+#else
+	qsi_no_xinerama(dzen.dpy, &si);
+#endif
+	t->x = t->rx;
+	t->y = t->ry;
+	t->width = t->rwidth;
+	s->x = s->rx;
+	s->width = s->rwidth;
+	x_check_geometry(si);
+	if(s->max_lines)
+		x_slave_geometry(si);
+
+	/* an '-hmenu' has the title window's geometry for its strut */
+	XMoveResizeWindow(dzen.dpy, t->win, t->x, t->y, t->width,
+			t->ishidden ? 1 : dzen.line_height);
+	if(!s->ishmenu) {
+		pm = XCreatePixmap(dzen.dpy, root, t->width, dzen.line_height,
+				DefaultDepth(dzen.dpy, dzen.screen));
+		XFreePixmap(dzen.dpy, t->drawable);
+		t->drawable = pm;
+		/* the title is laid out anew for its width */
+		XFillRectangle(dzen.dpy, pm, dzen.rgc, 0, 0, t->width, dzen.line_height);
+		if(t->text)
+			drawheader(t->text);
+		else
+			XCopyArea(dzen.dpy, t->drawable, t->win, dzen.gc, 0, 0,
+					t->width, dzen.line_height, 0, 0);
+	}
+	set_docking_ewmh_info(dzen.dpy, t->win, t->isdock);
+
+	/* a released slave window is created with the new geometry */
+	if(s->win) {
+		XMoveResizeWindow(dzen.dpy, s->win, s->x, s->y,
+				s->ishmenu ? t->width : s->width,
+				s->ishmenu ? dzen.line_height : s->max_lines * dzen.line_height);
+		XFreePixmap(dzen.dpy, s->drawable);
+		s->drawable = XCreatePixmap(dzen.dpy, root, s->width,
+				s->max_lines * dzen.line_height, DefaultDepth(dzen.dpy, dzen.screen));
+		if(s->rdrawable) {
+			XFreePixmap(dzen.dpy, s->rdrawable);
+			s->rdrawable = XCreatePixmap(dzen.dpy, root, s->width,
+					s->max_lines * dzen.line_height, DefaultDepth(dzen.dpy, dzen.screen));
 		}
+		x_forget_body();
+		x_draw_body();
 	}
-
 }
 
 static void
 x_map_window(Window win) {
 	XMapRaised(dzen.dpy, win);
-	XSync(dzen.dpy, False);
 }
 
 static void
-x_redraw(Window w) {
-	int i;
+x_damage_add(XRectangle *d, XExposeEvent *e) {
+	int x2, y2;
+
+	if(!d->width) {
+		d->x = e->x;
+		d->y = e->y;
+		d->width  = e->width;
+		d->height = e->height;
+		return;
+	}
+	x2 = d->x + d->width  > e->x + e->width  ? d->x + d->width  : e->x + e->width;
+	y2 = d->y + d->height > e->y + e->height ? d->y + d->height : e->y + e->height;
+	d->x = d->x < e->x ? d->x : e->x;
+	d->y = d->y < e->y ? d->y : e->y;
+	d->width  = x2 - d->x;
+	d->height = y2 - d->y;
+}
+
+/* merge exposed areas per window, they get repainted once
+ * after the event queue has been drained */
+static void
+x_damage(XExposeEvent *e) {
+	if(e->window == dzen.title_win.win)
+		x_damage_add(&title_dmg, e);
+	else if(e->window == dzen.slave_win.win)
+		x_damage_add(&slave_dmg, e);
+}
 
-	if(!dzen.slave_win.ishmenu
-			&& w == dzen.title_win.win)
-		drawheader(NULL);
-	if(!dzen.tsupdate && w == dzen.slave_win.win) {
-		for(i=0; i < dzen.slave_win.max_lines; i++)
-			XCopyArea(dzen.dpy, dzen.slave_win.drawable[i], dzen.slave_win.line[i], dzen.gc,
-					0, 0, dzen.slave_win.width, dzen.line_height, 0, 0);
+void
+x_repaint_damage(void) {
+	XRectangle *d;
+	int first, last;
+
+	if(title_dmg.width) {
+		d = &title_dmg;
+		if(!dzen.slave_win.ishmenu)
+			XCopyArea(dzen.dpy, dzen.title_win.drawable, dzen.title_win.win, dzen.gc,
+					d->x, d->y, d->width, d->height, d->x, d->y);
+		d->width = 0;
 	}
-	else {
-		for(i=0; i < dzen.slave_win.max_lines; i++)
-			if(w == dzen.slave_win.line[i]) {
-				XCopyArea(dzen.dpy, dzen.slave_win.drawable[i], dzen.slave_win.line[i], dzen.gc,
-						0, 0, dzen.slave_win.width, dzen.line_height, 0, 0);
-			}
+	if(slave_dmg.width) {
+		d = &slave_dmg;
+		/* whole rows are copied, there are few of them */
+		first = x_row_at(d->x, d->y);
+		last  = x_row_at(d->x + d->width-1, d->y + d->height-1);
+		if(first < 0)
+			first = 0;
+		if(last < 0)
+			last = dzen.slave_win.max_lines-1;
+		if(first <= last)
+			x_copy_rows(first, last-first+1);
+		d->width = 0;
 	}
 }
 
+/* menus highlight the row under the pointer */
+static void
+x_hover(int row) {
+	if(row == hilit_line)
+		return;
+	if(hilit_line >= 0)
+		x_unhilight_line(hilit_line);
+	if(row >= 0)
+		x_hilight_line(row);
+}
+
 static void
 handle_xev(void) {
 	XEvent ev;
-	int i, sa_clicked=0;
+	XRectangle r;
+	int i, row, bx, by, sa_clicked=0;
 	char buf[32];
 	KeySym ksym;
 
 	XNextEvent(dzen.dpy, &ev);
+	if(hostfile)
+		host_window(ev.xany.window);
 	switch(ev.type) {
 		case Expose:
-			if(ev.xexpose.count == 0)
-				x_redraw(ev.xexpose.window);
+			x_damage(&ev.xexpose);
 			break;
-		case EnterNotify:
-			if(dzen.slave_win.ismenu) {
-				for(i=0; i < dzen.slave_win.max_lines; i++)
-					if(ev.xcrossing.window == dzen.slave_win.line[i])
-						x_hilight_line(i);
+		case MapNotify:
+			if(ev.xmap.window == dzen.slave_win.win) {
+				dzen.slave_win.ismapped = True;
+				slave_release.tv_sec = 0;
+				x_draw_body();
 			}
+			break;
+		case UnmapNotify:
+			if(ev.xunmap.window == dzen.slave_win.win) {
+				dzen.slave_win.ismapped = False;
+				if(dzen.slave_win.idle > 0 && !dzen.slave_win.issticky) {
+					gettimeofday(&slave_release, NULL);
+					slave_release.tv_sec += dzen.slave_win.idle;
+				}
+			}
+			break;
+		case MotionNotify:
+			/* only the latest pointer position matters */
+			while(XCheckTypedWindowEvent(dzen.dpy, ev.xmotion.window, MotionNotify, &ev))
+				;
+			if(dzen.slave_win.ismenu && ev.xmotion.window == dzen.slave_win.win)
+				x_hover(x_row_at(ev.xmotion.x, ev.xmotion.y));
+			break;
+		case EnterNotify:
+			if(dzen.slave_win.ismenu && ev.xcrossing.window == dzen.slave_win.win)
+				x_hover(x_row_at(ev.xcrossing.x, ev.xcrossing.y));
 			if(!dzen.slave_win.ishmenu
 					&& ev.xcrossing.window == dzen.title_win.win)
 				do_action(entertitle);
@@ -682,11 +1124,8 @@ handle_xev(void) {
 				do_action(enterslave);
 			break;
 		case LeaveNotify:
-			if(dzen.slave_win.ismenu) {
-				for(i=0; i < dzen.slave_win.max_lines; i++)
-					if(ev.xcrossing.window == dzen.slave_win.line[i])
-						x_unhilight_line(i);
-			}
+			if(dzen.slave_win.ismenu && ev.xcrossing.window == dzen.slave_win.win)
+				x_hover(-1);
 			if(!dzen.slave_win.ishmenu
 					&& ev.xcrossing.window == dzen.title_win.win)
 				do_action(leavetitle);
@@ -695,24 +1134,30 @@ handle_xev(void) {
 			}
 			break;
 		case ButtonRelease:
-			if(dzen.slave_win.ismenu) {
-				for(i=0; i < dzen.slave_win.max_lines; i++)
-					if(ev.xbutton.window == dzen.slave_win.line[i])
-						dzen.slave_win.sel_line = i;
+			/* click areas of slave lines are relative to their row */
+			row = -1;
+			bx = ev.xbutton.x;
+			by = ev.xbutton.y;
+			if(ev.xbutton.window == dzen.slave_win.win
+					&& (row = x_row_at(bx, by)) >= 0) {
+				x_row_rect(row, &r);
+				bx -= r.x;
+				by -= r.y;
+				if(dzen.slave_win.ismenu)
+					dzen.slave_win.sel_line = row;
 			}
 
 			/* clickable areas */
              for(i=sens_areas_cnt-1; i>=0; i--) {
 				if((sens_areas[i].line < 0 ? 
 							ev.xbutton.window == dzen.title_win.win : 
-							sens_areas[i].line >= dzen.slave_win.first_line_vis &&
-							sens_areas[i].line <= dzen.slave_win.last_line_vis &&
-							ev.xbutton.window == dzen.slave_win.line[sens_areas[i].line-dzen.slave_win.first_line_vis]) &&
+							row >= 0 &&
+							sens_areas[i].line == dzen.slave_win.first_line_vis + row) &&
 						ev.xbutton.button == sens_areas[i].button &&
-						(ev.xbutton.x >=  sens_areas[i].start_x+xorig &&
-						ev.xbutton.x <=  sens_areas[i].end_x+xorig) &&
-						(ev.xbutton.y >=  sens_areas[i].start_y &&
-						ev.xbutton.y <=  sens_areas[i].end_y) &&
+						(bx >=  sens_areas[i].start_x+drawst.xorig &&
+						bx <=  sens_areas[i].end_x+drawst.xorig) &&
+						(by >=  sens_areas[i].start_y &&
+						by <=  sens_areas[i].end_y) &&
                         sens_areas[i].active) {
 					do_action(clickmarker+i);
 					sa_clicked++;
@@ -746,24 +1191,61 @@ handle_xev(void) {
 			}
 			break;
 		case KeyPress:
-			XLookupString(&ev.xkey, buf, sizeof buf, &ksym, 0);
+			i = XLookupString(&ev.xkey, buf, sizeof buf, &ksym, 0);
+			/* keys with an action of their own never reach the filter */
+			if(dzen.slave_win.isfilter
+					&& find_event(ksym+keymarker) == -1
+					&& filter_key(ksym, buf, i))
+				break;
 			do_action(ksym+keymarker);
 			break;
-
-		/* TODO: XRandR rotation and size  */
+		case ConfigureNotify:
+			if(ev.xconfigure.window == RootWindow(dzen.dpy, dzen.screen)) {
+#ifdef DZEN_XRANDR
+				XRRUpdateConfiguration(&ev);
+#else
+				/* what XRRUpdateConfiguration() would do */
+				ScreenOfDisplay(dzen.dpy, dzen.screen)->width  = ev.xconfigure.width;
+				ScreenOfDisplay(dzen.dpy, dzen.screen)->height = ev.xconfigure.height;
+#endif
+				screen_changed = 1;
+			}
+			break;
+#ifdef DZEN_XRANDR
+		default:
+			/* monitors changed, maybe without the screen size */
+			if(rr_event_base >= 0 && ev.type == rr_event_base + RRScreenChangeNotify) {
+				XRRUpdateConfiguration(&ev);
+				screen_changed = 1;
+			}
+#endif
 	}
 }
 
 static void
-handle_newl(void) {
-	XWindowAttributes wa;
-
+handle_xevents(void) {
+	while(XPending(dzen.dpy))
+		handle_xev();
+	/* once for a burst of screen changes */
+	if(screen_changed) {
+		screen_changed = 0;
+		if(hostfile)
+			host_foreach(x_reconfigure);
+		else
+			x_reconfigure();
+	}
+	x_repaint_damage();
+}
 
+void
+handle_newl(void) {
 	if(dzen.slave_win.max_lines && (dzen.slave_win.tcnt > last_cnt)) {
 		do_action(onnewinput);
 
-		if (XGetWindowAttributes(dzen.dpy, dzen.slave_win.win, &wa),
-				wa.map_state != IsUnmapped
+		/* a filtered menu keeps its position */
+		if(dzen.slave_win.fidx)
+			filter_update();
+		else if (dzen.slave_win.ismapped
 				/* autoscroll and redraw only if  we're
 				 * currently viewing the last line of input
 				 */
@@ -773,51 +1255,182 @@ handle_newl(void) {
 			x_draw_body();
 		}
 		/* needed for a_scrollhome */
-		else if(wa.map_state != IsUnmapped
+		else if(dzen.slave_win.ismapped
 				&& dzen.slave_win.last_line_vis == dzen.slave_win.max_lines)
 			x_draw_body();
 		/* forget state if window was unmapped */
-		else if(wa.map_state == IsUnmapped || !dzen.slave_win.last_line_vis) {
+		else if(!dzen.slave_win.ismapped || !dzen.slave_win.last_line_vis) {
 			dzen.slave_win.first_line_vis = 0;
 			dzen.slave_win.last_line_vis = 0;
 			x_draw_body();
 		}
 		last_cnt = dzen.slave_win.tcnt;
 	}
+	else if(body_changed)
+		x_draw_body();
+	body_changed = 0;
+}
+
+/* exchanges the state of this file that belongs to a bar with s,
+ * see host.c */
+void
+x_swap_bar(BarState *s) {
+	XRectangle r;
+	XSetWindowAttributes wa;
+	struct timeval tv;
+	click_a ca;
+	int i, n, tmp;
+
+	SWAP(title_dmg, s->title_dmg, r);
+	SWAP(slave_dmg, s->slave_dmg, r);
+	SWAP(slave_wa, s->slave_wa, wa);
+	SWAP(slave_release, s->slave_release, tv);
+	SWAP(hilit_line, s->hilit_line, tmp);
+	SWAP(body_changed, s->body_changed, tmp);
+	SWAP(last_cnt, s->last_cnt, tmp);
+
+	/* only the areas in use */
+	n = sens_areas_cnt > s->sens_areas_cnt ? sens_areas_cnt : s->sens_areas_cnt;
+	for(i=0; i < n; i++)
+		SWAP(sens_areas[i], s->sens_areas[i], ca);
+	SWAP(sens_areas_cnt, s->sens_areas_cnt, tmp);
+}
+
+/* '^ds()' values changed, redraw the title if it shows them */
+static void
+redraw_datasrc(void) {
+	if(dzen.title_win.text && datasrc_changed(dzen.title_win.text))
+		drawheader(dzen.title_win.text);
 }
 
 static void
 event_loop(void) {
-	int xfd, ret, dr=0;
+	int xfd, sfd, ifd, mfd = -1, maxfd, ret, dr=0;
+	int polled = 0;
+	char title[MAX_LINE_LEN];
 	fd_set rmask;
+	struct timeval deadline, now, tv, stv, dsnext = { 0, 0 }, *tvp;
 
 	xfd = ConnectionNumber(dzen.dpy);
+	sfd = sigpipe[0];
+	if(follow) {
+		/* input comes from the file instead of stdin, and never ends */
+		ifd = follow_start(follow, follow_tail, process_line);
+		handle_newl();
+		polled = ifd < 0;
+	}
+	else if(hostfile)
+		/* bars read their own input, see host.c */
+		ifd = -1;
+	else
+		ifd = dzen.input_thread ? input_start() : STDIN_FILENO;
+	maxfd = xfd > sfd ? xfd : sfd;
+	maxfd = maxfd > ifd ? maxfd : ifd;
+	if(shmpath) {
+		mfd = shm_start(shmpath);
+		maxfd = maxfd > mfd ? maxfd : mfd;
+	}
+	if(ctlpath)
+		control_start(ctlpath);
+	deadline.tv_sec = 0;
+
 	while(dzen.running) {
 		FD_ZERO(&rmask);
 		FD_SET(xfd, &rmask);
-		if(dr != -2)
-			FD_SET(STDIN_FILENO, &rmask);
-
-		while(XPending(dzen.dpy))
-			handle_xev();
+		FD_SET(sfd, &rmask);
+		if(dr != -2 && !polled && ifd >= 0)
+			FD_SET(ifd, &rmask);
+		if(mfd >= 0)
+			FD_SET(mfd, &rmask);
+
+		handle_xevents();
+
+		tvp = NULL;
+		if(hostfile)
+			host_deadline(&deadline);
+		if(deadline.tv_sec || slave_release.tv_sec || datasrc_active())
+			gettimeofday(&now, NULL);
+		if(deadline.tv_sec) {
+			/* '-p <seconds>' after EOF */
+			if(!timercmp(&now, &deadline, <))
+				return;
+			timersub(&deadline, &now, &tv);
+			tvp = &tv;
+		}
+		if(slave_release.tv_sec) {
+			/* '-slave-idle <seconds>' after collapsing */
+			if(!timercmp(&now, &slave_release, <))
+				x_destroy_slave();
+			else {
+				timersub(&slave_release, &now, &stv);
+				if(!tvp || timercmp(&stv, tvp, <)) {
+					tv = stv;
+					tvp = &tv;
+				}
+			}
+		}
+		if(datasrc_active()) {
+			/* '^ds()' sources are sampled on the second */
+			if(!timercmp(&now, &dsnext, <)) {
+				if(datasrc_tick()) {
+					if(hostfile)
+						host_foreach(redraw_datasrc);
+					else
+						redraw_datasrc();
+					XFlush(dzen.dpy);
+				}
+				dsnext.tv_sec = now.tv_sec + 1;
+				dsnext.tv_usec = 0;
+			}
+			timersub(&dsnext, &now, &stv);
+			if(!tvp || timercmp(&stv, tvp, <)) {
+				tv = stv;
+				tvp = &tv;
+			}
+		}
+		if(polled && (!tvp || tv.tv_sec >= 1)) {
+			/* '-follow' without inotify checks the file every second */
+			tv.tv_sec = 1;
+			tv.tv_usec = 0;
+			tvp = &tv;
+		}
 
-		ret = select(xfd+1, &rmask, NULL, NULL, NULL);
+		ret = select(host_fds(&rmask, control_fds(&rmask, maxfd))+1, &rmask, NULL, NULL, tvp);
+		if(ret < 0) {
+			if(errno == EINTR)
+				continue;
+			eprint("dzen: select failed\n");
+		}
+		if(follow && (polled || (ret > 0 && FD_ISSET(ifd, &rmask)))) {
+			follow_read();
+			handle_newl();
+		}
 		if(ret) {
-			if(dr != -2 && FD_ISSET(STDIN_FILENO, &rmask)) {
-				if((dr = read_stdin()) == -1)
+			if(FD_ISSET(sfd, &rmask))
+				handle_signals();
+			if(mfd >= 0 && FD_ISSET(mfd, &rmask) && shm_read(title))
+				drawheader(title);
+			if(control_handle(&rmask))
+				handle_newl();
+			host_handle(&rmask);
+			if(!follow && dr != -2 && ifd >= 0 && FD_ISSET(ifd, &rmask)) {
+#ifdef DZEN_DEBUG
+				dzen.roundtrips = 0;
+#endif
+				if((dr = dzen.input_thread ? read_queue() : read_stdin()) == -1)
 					return;
 				handle_newl();
-			}
-			if(dr == -2 && dzen.timeout > 0) {
-				/* set an alarm to kill us after the timeout */
-				struct itimerval t;
-				memset(&t, 0, sizeof t);
-				t.it_value.tv_sec = dzen.timeout;
-				t.it_value.tv_usec = 0;
-				setitimer(ITIMER_REAL, &t, NULL);
+#ifdef DZEN_DEBUG
+				if(dzen.roundtrips)
+					fprintf(stderr, "dzen: update needed %d round trip(s)\n", dzen.roundtrips);
+#endif
+				if(dr == -2 && dzen.timeout > 0) {
+					gettimeofday(&deadline, NULL);
+					deadline.tv_sec += dzen.timeout;
+				}
 			}
 			if(FD_ISSET(xfd, &rmask))
-				handle_xev();
+				handle_xevents();
 		}
 	}
 	return;
@@ -890,40 +1503,14 @@ init_input_buffer(void) {
 	else
 		dzen.slave_win.tsize = MIN_BUF_SIZE;
 
-	dzen.slave_win.tbuf = emalloc(dzen.slave_win.tsize * sizeof(char *));
+	/* tbuf itself is allocated with the first line, see drawbody() */
 }
 
-int
-main(int argc, char *argv[]) {
-	int i, use_ewmh_dock=0;
-	char *action_string = NULL;
-	char *endptr, *fnpre = NULL;
-
-	/* default values */
-	dzen.title_win.name = "dzen title";
-	dzen.slave_win.name = "dzen slave";
-	dzen.cur_line  = 0;
-	dzen.ret_val   = 0;
-	dzen.title_win.x = dzen.slave_win.x = 0;
-	dzen.title_win.y = 0;
-	dzen.title_win.width = dzen.slave_win.width = 0;
-	dzen.title_win.alignment = ALIGNCENTER;
-	dzen.slave_win.alignment = ALIGNLEFT;
-	dzen.fnt = FONT;
-	dzen.bg  = BGCOLOR;
-	dzen.fg  = FGCOLOR;
-	dzen.slave_win.max_lines  = 0;
-	dzen.running = True;
-	dzen.xinescreen = 0;
-	dzen.tsupdate = 0;
-	dzen.line_height = 0;
-	dzen.title_win.expand = noexpand;
-
-	/* Connect to X server */
-	x_connect();
-	x_read_resources();
+static void
+parse_args(int argc, char *argv[]) {
+	int i;
+	char *endptr;
 
-	/* cmdline args */
 	for(i = 1; i < argc; i++)
 		if(!strncmp(argv[i], "-l", 3)){
 			if(++i < argc) {
@@ -990,6 +1577,9 @@ main(int argc, char *argv[]) {
 		else if(!strncmp(argv[i], "-sa", 4)) {
 			if(++i < argc) dzen.slave_win.alignment = alignment_from_char(argv[i][0]);
 		}
+		else if(!strncmp(argv[i], "-filter", 8)) {
+			dzen.slave_win.isfilter = True;
+		}
 		else if(!strncmp(argv[i], "-m", 3)) {
 			dzen.slave_win.ismenu = True;
 			if(i+1 < argc) {
@@ -1012,6 +1602,9 @@ main(int argc, char *argv[]) {
 		else if(!strncmp(argv[i], "-slave-name", 12)) {
 			if(++i < argc) dzen.slave_win.name = argv[i];
 		}
+		else if(!strncmp(argv[i], "-slave-idle", 12)) {
+			if(++i < argc) dzen.slave_win.idle = atoi(argv[i]);
+		}
 		else if(!strncmp(argv[i], "-bg", 4)) {
 			if(++i < argc) dzen.bg = argv[i];
 		}
@@ -1033,6 +1626,37 @@ main(int argc, char *argv[]) {
 		else if(!strncmp(argv[i], "-tw", 4)) {
 			if(++i < argc) dzen.title_win.width = atoi(argv[i]);
 		}
+		else if(!strncmp(argv[i], "-shm", 5)) {
+			/* the title comes from producers, stdin may well end */
+			if(++i < argc) shmpath = argv[i];
+			dzen.ispersistent = True;
+		}
+		else if(!strncmp(argv[i], "-socket", 8)) {
+			if(++i < argc) ctlpath = argv[i];
+			dzen.ispersistent = True;
+		}
+		else if(!strncmp(argv[i], "-host", 6)) {
+			if(++i < argc) hostfile = argv[i];
+		}
+		else if(!strncmp(argv[i], "-in", 4)) {
+			if(++i < argc) input = argv[i];
+		}
+		else if(!strncmp(argv[i], "-follow", 8)) {
+			if(++i < argc) follow = argv[i];
+		}
+		else if(!strncmp(argv[i], "-tail", 6)) {
+			if(++i < argc && (follow_tail = atoi(argv[i])) < 0)
+				eprint("dzen: '-tail' needs a number of lines >= 0\n");
+		}
+		else if(!strncmp(argv[i], "-history", 9)) {
+			if(++i < argc) history = argv[i];
+		}
+		else if(!strncmp(argv[i], "-collapse-repeats", 18)) {
+			dzen.slave_win.collapse_repeats = True;
+		}
+		else if(!strncmp(argv[i], "-colorize", 10)) {
+			if(++i < argc) colorize = argv[i];
+		}
 		else if(!strncmp(argv[i], "-fn-preload", 12)) {
 			if(++i < argc) {
 				fnpre = estrdup(argv[i]);
@@ -1045,6 +1669,8 @@ main(int argc, char *argv[]) {
 #endif
 		else if(!strncmp(argv[i], "-dock", 6))
 			use_ewmh_dock = 1;
+		else if(!strncmp(argv[i], "-input-thread", 14))
+			dzen.input_thread = True;
 		else if(!strncmp(argv[i], "-v", 3)) {
 			printf("dzen-"VERSION", (C)opyright 2007-2009 Robert Manea\n");
 			printf(
@@ -1057,33 +1683,50 @@ main(int argc, char *argv[]) {
 #endif
 #ifdef DZEN_XINERAMA
 			" XINERAMA "
+#endif
+#ifdef DZEN_XRANDR
+			" XRANDR "
 #endif
 			"\n"
 			);
-			return EXIT_SUCCESS;
+			exit(EXIT_SUCCESS);
 		}
 		else
 			eprint("usage: dzen2 [-v] [-p [seconds]] [-m [v|h]] [-ta <l|c|r>] [-sa <l|c|r>]\n"
                    "             [-x <pixel>] [-y <pixel>] [-w <pixel>] [-h <pixel>] [-tw <pixel>] [-u]\n"
 				   "             [-e <string>] [-l <lines>]  [-fn <font>] [-bg <color>] [-fg <color>]\n"
-				   "             [-geometry <geometry string>] [-expand <left|right>] [-dock]\n"
-				   "             [-title-name <string>] [-slave-name <string>]\n"
+				   "             [-geometry <geometry string>] [-expand <left|right>] [-dock] [-input-thread]\n"
+				   "             [-title-name <string>] [-slave-name <string>] [-slave-idle <seconds>]\n"
+				   "             [-colorize <pattern=color;...>] [-filter] [-history <file>]\n"
+				   "             [-collapse-repeats] [-follow <file>] [-tail <lines>]\n"
+				   "             [-shm <file>] [-socket <path>] [-host <file>]\n"
+				   "             -follow, -shm, -socket, -colorize, -history, -filter, -slave-idle\n"
+				   "             and -input-thread are not available with -host\n"
 #ifdef DZEN_XINERAMA
 				   "             [-xs <screen>]\n"
 #endif
 				  );
+}
 
+/* sets up the windows and events of the bar the options describe,
+ * once for every bar in host mode */
+static void
+setup_bar(void) {
 	if(dzen.tsupdate && !dzen.slave_win.max_lines)
 		dzen.tsupdate = False;
+	if(!dzen.slave_win.ismenu)
+		dzen.slave_win.isfilter = False;
 
 	if(!dzen.title_win.width)
 		dzen.title_win.width = dzen.slave_win.width;
 
-	if(!setlocale(LC_ALL, "") || !XSupportsLocale())
-		puts("dzen: locale not available, expect problems with fonts.\n");
-
-	if(action_string)
-		fill_ev_table(action_string);
+	if(action_string) {
+		/* the table is filled by cutting up the string, which may be
+		 * the default of other bars */
+		char *s = estrdup(action_string);
+		fill_ev_table(s);
+		free(s);
+	}
 	else {
 		if(!dzen.slave_win.max_lines) {
 			char edef[] = "button3=exit:13";
@@ -1107,46 +1750,127 @@ main(int argc, char *argv[]) {
 			fill_ev_table(edef);
 		}
 	}
-
-	if((find_event(onexit) != -1)
-			&& (setup_signal(SIGTERM, catch_sigterm) == SIG_ERR))
-		fprintf(stderr, "dzen: error hooking SIGTERM\n");
-
-	if((find_event(sigusr1) != -1)
-			&& (setup_signal(SIGUSR1, catch_sigusr1) == SIG_ERR))
-		fprintf(stderr, "dzen: error hooking SIGUSR1\n");
-
-	if((find_event(sigusr2) != -1)
-		&& (setup_signal(SIGUSR2, catch_sigusr2) == SIG_ERR))
-		fprintf(stderr, "dzen: error hooking SIGUSR2\n");
-
-	if(setup_signal(SIGALRM, catch_alrm) == SIG_ERR)
-		fprintf(stderr, "dzen: error hooking SIGALARM\n");
+	intern_action_atoms();
 
 	if(dzen.slave_win.ishmenu &&
 			!dzen.slave_win.max_lines)
 		dzen.slave_win.max_lines = 1;
 
-
 	x_create_windows(use_ewmh_dock);
+	if(colorize && dzen.slave_win.max_lines)
+		colorize_init(colorize);
+	if(history && dzen.slave_win.max_lines) {
+		dzen.slave_win.ishistory = True;
+		dzen.slave_win.tcnt = history_open(history);
+	}
 
 	if(!dzen.slave_win.ishmenu)
 		x_map_window(dzen.title_win.win);
-	else {
+	else
 		XMapRaised(dzen.dpy, dzen.slave_win.win);
-		for(i=0; i < dzen.slave_win.max_lines; i++)
-			XMapWindow(dzen.dpy, dzen.slave_win.line[i]);
-	}
 
 	if( fnpre != NULL )
 		font_preload(fnpre);
 
 	do_action(onstart);
+}
+
+/* options dzen only has once, not per bar */
+static void
+host_check(void) {
+	if(follow || shmpath || ctlpath || colorize || history
+			|| dzen.slave_win.isfilter || dzen.slave_win.idle || dzen.input_thread)
+		eprint("dzen: '-follow', '-shm', '-socket', '-colorize', '-history', '-filter',\n"
+				"      '-slave-idle' and '-input-thread' cannot be used with '-host'\n");
+}
+
+/* sets up a bar from a line of the '-host' file, returns its input */
+static const char *
+host_bar(int argc, char *argv[]) {
+	char *h = hostfile;
+
+	/* bars start out from the options given to dzen itself */
+	use_ewmh_dock = host_dock;
+	action_string = host_actions;
+	fnpre = host_fnpre;
+	input = NULL;
+	parse_args(argc, argv);
+	if(hostfile != h)
+		eprint("dzen: '-host' cannot be used in a '-host' file\n");
+	host_check();
+	setup_bar();
+	return input;
+}
+
+int
+main(int argc, char *argv[]) {
+	/* default values */
+	dzen.title_win.name = "dzen title";
+	dzen.slave_win.name = "dzen slave";
+	dzen.cur_line  = 0;
+	dzen.ret_val   = 0;
+	dzen.title_win.x = dzen.slave_win.x = 0;
+	dzen.title_win.y = 0;
+	dzen.title_win.width = dzen.slave_win.width = 0;
+	dzen.title_win.alignment = ALIGNCENTER;
+	dzen.slave_win.alignment = ALIGNLEFT;
+	dzen.fnt = FONT;
+	dzen.bg  = BGCOLOR;
+	dzen.fg  = FGCOLOR;
+	dzen.slave_win.max_lines  = 0;
+	dzen.running = True;
+	dzen.xinescreen = 0;
+	dzen.tsupdate = 0;
+	dzen.line_height = 0;
+	dzen.title_win.expand = noexpand;
+
+	/* Connect to X server */
+	x_connect();
+	x_read_resources();
+
+
+	/* cmdline args */
+	parse_args(argc, argv);
+
+	if(!setlocale(LC_ALL, "") || !XSupportsLocale())
+		puts("dzen: locale not available, expect problems with fonts.\n");
+
+	setup_signal_pipe();
+	x_intern_atoms();
+
+	if(hostfile) {
+		host_check();
+		host_dock = use_ewmh_dock;
+		host_actions = action_string;
+		host_fnpre = fnpre;
+		host_start(hostfile, host_bar);
+	}
+	else {
+		if(input)
+			eprint("dzen: '-in' is only used in '-host' files\n");
+		setup_bar();
+	}
+
+	/* in host mode any bar may have handlers */
+	if((hostfile || find_event(onexit) != -1)
+			&& (setup_signal(SIGTERM, catch_signal) == SIG_ERR))
+		fprintf(stderr, "dzen: error hooking SIGTERM\n");
+
+	if((hostfile || find_event(sigusr1) != -1)
+			&& (setup_signal(SIGUSR1, catch_signal) == SIG_ERR))
+		fprintf(stderr, "dzen: error hooking SIGUSR1\n");
+
+	if((hostfile || find_event(sigusr2) != -1)
+		&& (setup_signal(SIGUSR2, catch_signal) == SIG_ERR))
+		fprintf(stderr, "dzen: error hooking SIGUSR2\n");
 
 	/* main loop */
 	event_loop();
 
-	do_action(onexit);
+	if(hostfile)
+		host_foreach(on_exit_action);
+	else
+		do_action(onexit);
 	clean_up();
 
 	if(dzen.ret_val)
@@ -1154,4 +1878,3 @@ main(int argc, char *argv[]) {
 
 	return EXIT_SUCCESS;
 }
-
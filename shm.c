@@ -0,0 +1,191 @@
+/*
+ * (C)opyright 2007-2009 Robert Manea <rob dot manea at gmail dot com>
+ * See LICENSE file for license details.
+ *
+ */
+
+/* Shared memory title input, see '-shm' and dzen-shm.h.
+ *
+ * A waiter thread sleeps on the futex word of the slot table and
+ * writes to a pipe the X thread select()s on.  After waking the X
+ * thread once it waits until that has read the slots, so however fast
+ * producers write, the X thread is woken at most once per redraw and
+ * producers never enter the kernel while it is busy.
+ */
+
+#include "dzen.h"
+#include "dzen-shm.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SHM_RETRIES 1000	/* reads of a slot before keeping its old text */
+
+static struct dzen_shm *shm;
+static int wakepipe[2] = { -1, -1 };
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static int notified;
+static uint32_t seen;		/* shm->wake when the X thread last read the slots */
+static uint32_t lastseq[DZEN_SHM_SLOTS];
+static char text[DZEN_SHM_SLOTS][DZEN_SHM_SLOT_LEN];
+
+/* sleeps while shm->wake is still w */
+static void
+shm_sleep(uint32_t w) {
+#ifdef __linux__
+	syscall(SYS_futex, &shm->wake, FUTEX_WAIT, w, NULL, NULL, 0);
+#else
+	struct timespec ts = { 0, 10000000L };
+
+	(void)w;
+	nanosleep(&ts, NULL);
+#endif
+}
+
+static void *
+shm_waiter(void *arg) {
+	uint32_t w;
+	char c = 0;
+
+	(void)arg;
+	for(;;) {
+		pthread_mutex_lock(&lock);
+		while(notified)
+			pthread_cond_wait(&cond, &lock);
+		w = seen;
+		pthread_mutex_unlock(&lock);
+
+		/* producers only call FUTEX_WAKE while waiting is set */
+		while(__atomic_load_n(&shm->wake, __ATOMIC_SEQ_CST) == w) {
+			__atomic_store_n(&shm->waiting, 1, __ATOMIC_SEQ_CST);
+			if(__atomic_load_n(&shm->wake, __ATOMIC_SEQ_CST) == w)
+				shm_sleep(w);
+			__atomic_store_n(&shm->waiting, 0, __ATOMIC_SEQ_CST);
+		}
+
+		pthread_mutex_lock(&lock);
+		notified = 1;
+		pthread_mutex_unlock(&lock);
+		if(write(wakepipe[1], &c, 1) < 0)
+			;
+	}
+	return NULL;
+}
+
+/* maps the slot table at path, creating it if needed, and returns
+ * the descriptor to select() on */
+int
+shm_start(const char *path) {
+	struct stat st;
+	pthread_t tid;
+	int fd, i;
+
+	if((fd = open(path, O_RDWR | O_CREAT, 0600)) < 0)
+		eprint("dzen: cannot open shared memory file '%s'\n", path);
+	if(fstat(fd, &st) < 0)
+		eprint("dzen: cannot stat shared memory file '%s'\n", path);
+	if(st.st_size < (off_t)sizeof(struct dzen_shm)
+			&& ftruncate(fd, sizeof(struct dzen_shm)) < 0)
+		eprint("dzen: cannot resize shared memory file '%s'\n", path);
+	shm = mmap(NULL, sizeof(struct dzen_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if(shm == MAP_FAILED)
+		eprint("dzen: cannot map shared memory file '%s'\n", path);
+	close(fd);
+
+	/* a table set up by a producer started first is kept */
+	if(shm->magic != DZEN_SHM_MAGIC || shm->nslots != DZEN_SHM_SLOTS) {
+		memset(shm, 0, sizeof(struct dzen_shm));
+		shm->nslots = DZEN_SHM_SLOTS;
+		__atomic_store_n(&shm->magic, DZEN_SHM_MAGIC, __ATOMIC_SEQ_CST);
+	}
+	/* whatever is in the table already is drawn right away */
+	seen = __atomic_load_n(&shm->wake, __ATOMIC_SEQ_CST) - 1;
+
+	if(pipe(wakepipe) < 0)
+		eprint("dzen: cannot create shared memory pipe\n");
+	for(i=0; i < 2; i++) {
+		fcntl(wakepipe[i], F_SETFL, fcntl(wakepipe[i], F_GETFL) | O_NONBLOCK);
+		fcntl(wakepipe[i], F_SETFD, FD_CLOEXEC);
+	}
+	if(pthread_create(&tid, NULL, shm_waiter, NULL))
+		eprint("dzen: cannot create shared memory thread\n");
+	pthread_detach(tid);
+
+	return wakepipe[0];
+}
+
+/* copies slot n into text[n], returns 1 if it changed */
+static int
+read_slot(int n) {
+	struct dzen_shm_slot *s = &shm->slot[n];
+	char buf[DZEN_SHM_SLOT_LEN];
+	uint32_t s1, len;
+	int tries;
+
+	for(tries=0; tries < SHM_RETRIES; tries++) {
+		s1 = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+		if(s1 == lastseq[n])
+			return 0;
+		if(s1 & 1) {
+			sched_yield();
+			continue;
+		}
+		len = __atomic_load_n(&s->len, __ATOMIC_RELAXED);
+		if(len >= DZEN_SHM_SLOT_LEN)
+			len = DZEN_SHM_SLOT_LEN - 1;
+		memcpy(buf, s->text, len);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if(__atomic_load_n(&s->seq, __ATOMIC_RELAXED) != s1)
+			continue;
+
+		buf[len] = '\0';
+		/* a newline would end the title line */
+		len = strcspn(buf, "\n");
+		buf[len] = '\0';
+		memcpy(text[n], buf, len + 1);
+		lastseq[n] = s1;
+		return 1;
+	}
+	return 0;
+}
+
+/* reads the slots that changed since the last call into title, which
+ * holds MAX_LINE_LEN bytes.  Returns 1 if the title has to be redrawn. */
+int
+shm_read(char *title) {
+	char buf[64];
+	uint32_t w;
+	int i, changed = 0;
+	size_t len = 0, l;
+
+	while(read(wakepipe[0], buf, sizeof buf) > 0)
+		;
+	w = __atomic_load_n(&shm->wake, __ATOMIC_SEQ_CST);
+
+	for(i=0; i < DZEN_SHM_SLOTS; i++)
+		changed |= read_slot(i);
+
+	/* writes after w was read wake the waiter again */
+	pthread_mutex_lock(&lock);
+	seen = w;
+	notified = 0;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&lock);
+
+	if(!changed)
+		return 0;
+	for(i=0; i < DZEN_SHM_SLOTS; i++) {
+		l = strlen(text[i]);
+		memcpy(title + len, text[i], l);
+		len += l;
+	}
+	title[len] = '\0';
+	return 1;
+}